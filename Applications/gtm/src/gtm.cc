@@ -87,7 +87,11 @@ void parse_stdin (std::string const& grammarSelector = "text.plain", bool verbos
 			std::cout << xml_difference(lastScope, grammarSelector, "<", ">") << std::endl;
 
 			if(verbose)
+			{
+				parse::statistics_t const stats = parse::statistics();
 				fprintf(stderr, "parsed %zu bytes in %.1fs (%.0f bytes/s)\n", bytes, timer.duration(), bytes / timer.duration());
+				fprintf(stderr, "%zu regexp searches (%.2f per byte), %zu skipped by first byte check\n", stats.regexp_searches, stats.regexp_searches / (double)std::max<size_t>(stats.bytes_parsed, 1), stats.regexp_searches_skipped);
+			}
 
 			return;
 		}
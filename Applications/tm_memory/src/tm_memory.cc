@@ -0,0 +1,131 @@
+#include <buffer/buffer.h>
+#include <undo/undo.h>
+#include <test/bundle_index.h>
+#include <io/path.h>
+#include <oak/duration.h>
+#include <oak/oak.h>
+
+static double const AppVersion = 1.0;
+
+static void version ()
+{
+	fprintf(stdout, "%1$s %2$.1f (" __DATE__ ")\n", getprogname(), AppVersion);
+}
+
+static void usage (FILE* io)
+{
+	fprintf(io,
+		"%1$s %2$.1f (" __DATE__ ")\n"
+		"Usage: %1$s [-g<grammar>e<count>lhv] file ...\n"
+		"Report memory used by a buffer holding each file.\n"
+		"\n"
+		"Options:\n"
+		" -g, --grammar <grammar>   Parse the files using this grammar (tmLanguage file).\n"
+		" -e, --edits <count>       Make this many single character edits to populate the undo stack.\n"
+		" -l, --verbose             Be verbose (output timings).\n"
+		" -h, --help                Show this information.\n"
+		" -v, --version             Print version information.\n"
+		"\n", getprogname(), AppVersion
+	);
+}
+
+static bundles::item_ptr load_grammar (test::bundle_index_t& bundleIndex, std::string const& path)
+{
+	plist::dictionary_t const plist = plist::load(path);
+	if(plist.empty())
+	{
+		fprintf(stderr, "%s: error reading grammar ‘%s’\n", getprogname(), path.c_str());
+		exit(EX_NOINPUT);
+	}
+
+	bundles::item_ptr res = bundleIndex.add(bundles::kItemTypeGrammar, plist);
+	if(!res || !bundleIndex.commit())
+	{
+		fprintf(stderr, "%s: error parsing grammar ‘%s’\n", getprogname(), path.c_str());
+		exit(EX_PROTOCOL);
+	}
+	return res;
+}
+
+int main (int argc, char* const* argv)
+{
+	extern char* optarg;
+	extern int optind;
+
+	static struct option const longopts[] = {
+		{ "grammar",          required_argument,   0,      'g'   },
+		{ "edits",            required_argument,   0,      'e'   },
+		{ "verbose",          no_argument,         0,      'l'   },
+		{ "help",             no_argument,         0,      'h'   },
+		{ "version",          no_argument,         0,      'v'   },
+		{ 0,                  0,                   0,      0     }
+	};
+
+	bool verbose = false;
+	size_t edits = 0;
+	std::string grammar = NULL_STR;
+
+	int ch;
+	while((ch = getopt_long(argc, argv, "g:e:lhv", longopts, nullptr)) != -1)
+	{
+		switch(ch)
+		{
+			case 'g': grammar = optarg;                       break;
+			case 'e': edits = strtol(optarg, nullptr, 10);    break;
+			case 'l': verbose = true;                         break;
+			case 'h': usage(stdout);                          return EX_OK;
+			case 'v': version();                              return EX_OK;
+			default:  usage(stderr);                          return EX_USAGE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if(argc == 0)
+		return usage(stderr), EX_USAGE;
+
+	test::bundle_index_t bundleIndex;
+	bundles::item_ptr grammarItem = grammar != NULL_STR ? load_grammar(bundleIndex, grammar) : bundles::item_ptr();
+
+	for(int i = 0; i < argc; ++i)
+	{
+		if(access(argv[i], R_OK) != 0)
+		{
+			fprintf(stderr, "%s: error reading file ‘%s’\n", getprogname(), argv[i]);
+			return EX_NOINPUT;
+		}
+
+		oak::duration_t timer;
+
+		ng::buffer_t buffer;
+		ng::undo_manager_t undoManager(buffer);
+		buffer.insert(0, path::content(argv[i]));
+		if(grammarItem)
+		{
+			buffer.set_grammar(grammarItem);
+			buffer.wait_for_repair();
+		}
+
+		for(size_t n = 0; n < edits; ++n)
+		{
+			size_t const pos = buffer.sanitize_index(arc4random_uniform(buffer.size() + 1));
+			undoManager.begin_undo_group(ng::ranges_t(pos));
+			buffer.insert(pos, "x");
+			undoManager.end_undo_group(ng::ranges_t(pos + 1));
+		}
+
+		ng::memory_usage_t usage = buffer.memory_usage();
+		usage.add(undoManager.memory_usage());
+
+		auto const fragmentation = buffer.fragmentation();
+		fprintf(stdout, "%s (%zu bytes, %zu lines):\n%s", argv[i], buffer.size(), buffer.lines(), to_s(usage).c_str());
+		fprintf(stdout, "%zu text chunks (%zu small), %zu unreferenced bytes\n", fragmentation.chunks, fragmentation.small_chunks, fragmentation.wasted);
+		if(verbose)
+			fprintf(stderr, "loaded, parsed, and edited in %.2f seconds\n", timer.duration());
+		if(i + 1 < argc)
+			fprintf(stdout, "\n");
+	}
+
+	return EX_OK;
+}
@@ -7,6 +7,7 @@
 #import <SoftwareUpdate/OakDownloadManager.h>
 #import <bundles/locations.h>
 #import <bundles/query.h> // set_index
+#import <parse/grammar.h>
 #import <regexp/format_string.h>
 #import <text/ctype.h>
 #import <text/decode.h>
@@ -519,6 +520,7 @@ namespace
 		bundlesPaths.push_back(path::join(path, "Bundles"));
 	bundlesIndexPath = path::join(path::home(), "Library/Caches/com.macromates.TextMate/BundlesIndex.binary");
 	cache.set_content_filter(&prune_dictionary);
+	parse::set_grammar_cache_path(path::join(path::home(), "Library/Caches/com.macromates.TextMate/Grammars"));
 
 	// LEGACY bundle index used prior to 2.0-alpha.9467
 	std::string const oldPath = path::join(path::home(), "Library/Caches/com.macromates.TextMate/BundlesIndex.plist");
@@ -349,6 +349,7 @@ struct document_view_t : ng::buffer_api_t
 	std::string operator[] (size_t i) const { return [_document_editor buffer][i]; }
 	std::string substr (size_t from = 0, size_t to = SIZE_T_MAX) const { return [_document_editor buffer].substr(from, to != SIZE_T_MAX ? to : size()); }
 	std::string xml_substr (size_t from = 0, size_t to = SIZE_T_MAX) const { return [_document_editor buffer].xml_substr(from, to); }
+	std::string_view view (size_t from, size_t to, std::string& scratch) const { return [_document_editor buffer].view(from, to, scratch); }
 	bool visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const { return [_document_editor buffer].visit_data(f); }
 	size_t begin (size_t n) const { return [_document_editor buffer].begin(n); }
 	size_t eol (size_t n) const { return [_document_editor buffer].eol(n); }
@@ -3,11 +3,16 @@
 #include <oak/oak.h>
 #include <text/utf8.h>
 #include <text/parse.h>
+#include <text/newlines.h>
 #include <regexp/format_string.h>
 #include <parse/grammar.h>
 
 namespace ng
 {
+	static size_t const kCompactionMinimumChunks = 1024;
+	static size_t const kCompactionSliceBudget   = 256*1024; // bytes copied per slice, well below a millisecond
+	static double const kCompactionIdleDelay     = 2;
+
 	buffer_t::buffer_t () : _grammar_callback(*this), _revision(0), _next_revision(1), _spelling_language("")
 	{
 		_meta_data.push_back((_symbols = std::make_shared<symbols_t>()).get());
@@ -103,10 +108,15 @@ namespace ng
 		return _storage.substr(from, to);
 	}
 
-	bool buffer_t::visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const
+	std::string_view buffer_t::view (size_t from, size_t to, std::string& scratch) const
+	{
+		return _storage.view(from, to, scratch);
+	}
+
+	static bool visit_storage (detail::storage_t const& storage, std::function<void(char const*, size_t, size_t, bool*)> const& f)
 	{
 		size_t offset = 0;
-		for(auto memory : _storage)
+		for(auto memory : storage)
 		{
 			bool stop = false;
 			f(memory.data(), offset, memory.size(), &stop);
@@ -117,6 +127,16 @@ namespace ng
 		return false;
 	}
 
+	bool buffer_t::visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const
+	{
+		return visit_storage(_storage, f);
+	}
+
+	bool snapshot_t::visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const
+	{
+		return visit_storage(_storage, f);
+	}
+
 	bool buffer_t::operator== (buffer_t const& rhs) const
 	{
 		return _storage == rhs._storage;
@@ -149,14 +169,65 @@ namespace ng
 		return from + len;
 	}
 
-	size_t buffer_t::actual_replace (size_t from, size_t to, char const* buf, size_t len)
+	size_t buffer_t::actual_replace (size_t from, size_t to, char const* buf, size_t len, std::shared_ptr<void const> const& owner)
 	{
 		ASSERT_LE(from, to); ASSERT_LE(to, size());
 		_callbacks(&callback_t::will_replace, from, to, buf, len);
 
 		_storage.erase(from, to);
-		_storage.insert(from, buf, len);
+		if(owner)
+				_storage.insert(from, buf, len, owner);
+		else	_storage.insert(from, buf, len);
+		update_indices(from, to, buf, len);
+
+		_callbacks(&callback_t::did_replace, from, to, buf, len);
+		return from + len;
+	}
+
+	size_t buffer_t::replace (std::multimap<std::pair<size_t, size_t>, std::string> const& replacements)
+	{
+		if(replacements.empty())
+			return 0;
+		else if(replacements.size() == 1)
+			return replace(replacements.begin()->first.first, replacements.begin()->first.second, replacements.begin()->second);
+
+		size_t const first = replacements.begin()->first.first;
+		size_t last = first, newSize = 0;
+		for(auto const& pair : replacements)
+		{
+			ASSERT_LE(last, pair.first.first); ASSERT_LE(pair.first.first, pair.first.second);
+			newSize += pair.first.first - last + pair.second.size();
+			last = pair.first.second;
+		}
+		ASSERT_LE(last, size());
+
+		std::string const original = _storage.substr(first, last);
+		std::string text;
+		text.reserve(newSize);
+
+		size_t pos = first;
+		for(auto const& pair : replacements)
+		{
+			text.append(original, pos - first, pair.first.first - pos);
+			text.append(pair.second);
+			pos = pair.first.second;
+		}
 
+		_callbacks(&callback_t::will_replace, first, last, text.data(), text.size());
+
+		_storage.erase(first, last);
+		_storage.insert(first, text.data(), text.size());
+
+		// Indices are updated per range (back to front so that original coordinates stay valid) to keep scopes and parser states for the text between replacements
+		for(auto it = replacements.rbegin(); it != replacements.rend(); ++it)
+			update_indices(it->first.first, it->first.second, it->second.data(), it->second.size());
+
+		_callbacks(&callback_t::did_replace, first, last, text.data(), text.size());
+		return first + text.size();
+	}
+
+	void buffer_t::update_indices (size_t from, size_t to, char const* buf, size_t len)
+	{
 		_dirty.replace(from, to, len, false);
 		_dirty.set(from, true);
 
@@ -168,17 +239,63 @@ namespace ng
 			_scopes.set(from + len, preserveScope);
 		_parser_states.replace(from, to, len, false);
 
-		for(size_t i = 0; i < len; ++i)
+		if(_line_progress.position != SIZE_T_MAX)
 		{
-			if(buf[i] == '\n')
-				_hardlines.set(from + i, true);
+			if(to < _line_progress.position)
+			{
+				_line_progress.position = _line_progress.position - (to - from) + len;
+				_line_progress.eol      = _line_progress.eol - (to - from) + len;
+			}
+			else if(from <= _line_progress.eol)
+			{
+				_line_progress = { };
+			}
 		}
 
+		std::vector<size_t> positions;
+		text::find_newlines(buf, len, positions, from);
+		std::vector<std::pair<ssize_t, bool>> newlines;
+		newlines.reserve(positions.size());
+		for(size_t pos : positions)
+			newlines.emplace_back(pos, true);
+		_hardlines.set_range(from, from + len, newlines);
+
 		for(auto const& hook : _meta_data)
 			hook->replace(this, from, to, len);
 
-		_callbacks(&callback_t::did_replace, from, to, buf, len);
-		return from + len;
+		++_edits;
+		if(_async_parsing && !_compaction_scheduled && _storage.chunks() > std::max(kCompactionMinimumChunks, 2 * _compacted_chunks))
+		{
+			_compaction_scheduled = true;
+			schedule_compaction(kCompactionIdleDelay);
+		}
+	}
+
+	// Runs one slice of compaction after delay seconds, if the buffer was edited meanwhile we wait again so that compaction only happens when the user is idle
+	void buffer_t::schedule_compaction (double delay)
+	{
+		size_t const edits = _edits;
+		std::weak_ptr<bool> bufferRef = _compaction_reference;
+
+		CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+		dispatch_after(dispatch_time(DISPATCH_TIME_NOW, int64_t(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+			CFRunLoopPerformBlock(runLoop, kCFRunLoopDefaultMode, ^{
+				if(!bufferRef.lock())
+					return;
+
+				if(edits != _edits)
+					return schedule_compaction(kCompactionIdleDelay);
+
+				_compaction_offset = _storage.compact(std::min(_compaction_offset, _storage.size()), kCompactionSliceBudget);
+				if(_compaction_offset < _storage.size())
+					return schedule_compaction(0);
+
+				_compaction_offset    = 0;
+				_compacted_chunks     = _storage.chunks();
+				_compaction_scheduled = false;
+			});
+			CFRunLoopWakeUp(runLoop);
+		});
 	}
 
 	bool buffer_t::set_grammar (bundles::item_ptr const& grammarItem)
@@ -189,6 +306,7 @@ namespace ng
 		_scopes.clear();
 		_parser_states.clear();
 		_dirty.clear();
+		_speculation_failed = false;
 
 		std::string rootScope = NULL_STR;
 		plist::get_key_path(grammarItem->plist(), bundles::kFieldGrammarScope, rootScope);
@@ -201,7 +319,7 @@ namespace ng
 			_parser_states.set(-1, grammar->seed());
 			_dirty.set(0, true);
 
-			initiate_repair(10);
+			initiate_repair();
 
 			return true;
 		}
@@ -346,6 +464,19 @@ namespace ng
 	std::pair<size_t, std::string> buffer_t::next_mark (size_t index, std::string const& markType) const          { return _marks->next(index, markType); }
 	std::pair<size_t, std::string> buffer_t::prev_mark (size_t index, std::string const& markType) const          { return _marks->prev(index, markType); }
 
+	memory_usage_t buffer_t::memory_usage () const
+	{
+		memory_usage_t res;
+		_storage.memory_usage(res);
+		res.add("hardlines",     _hardlines.memory_usage(),     _hardlines.size());
+		res.add("dirty",         _dirty.memory_usage(),         _dirty.size());
+		res.add("scopes",        _scopes.memory_usage(),        _scopes.size());
+		res.add("parser states", _parser_states.memory_usage(), _parser_states.size());
+		for(auto const& hook : _meta_data)
+			hook->memory_usage(res);
+		return res;
+	}
+
 	// ========
 	// = to_s =
 	// ========
@@ -2,7 +2,9 @@
 #define COMPOSITE_H_BOKD8YWS
 
 #include "indexed_map.h"
+#include "indexed_btree.h"
 #include "storage.h"
+#include "memory_usage.h"
 #include <oak/callbacks.h>
 #include <text/types.h>
 #include <text/indent.h>
@@ -23,6 +25,7 @@ namespace ng
 		virtual ~meta_data_t ()                                                     { }
 		virtual void replace (buffer_t* buffer, size_t from, size_t to, size_t len) { }
 		virtual void did_parse (buffer_t const* buffer, size_t from, size_t to)     { }
+		virtual void memory_usage (memory_usage_t& usage) const                     { }
 	};
 
 	struct pairs_t : meta_data_t
@@ -38,6 +41,7 @@ namespace ng
 	private:
 		void replace (buffer_t* buffer, size_t from, size_t to, size_t len);
 		using meta_data_t::did_parse;
+		void memory_usage (memory_usage_t& usage) const;
 
 		bool is_paired (size_t index) const;
 
@@ -57,6 +61,7 @@ namespace ng
 	struct spelling_t;
 	struct symbols_t;
 	struct marks_t;
+	struct repair_line_t;
 
 	struct buffer_api_t
 	{
@@ -65,6 +70,7 @@ namespace ng
 		virtual std::string operator[] (size_t i) const = 0;
 		virtual std::string substr (size_t from, size_t to) const = 0;
 		virtual std::string xml_substr (size_t from = 0, size_t to = SIZE_T_MAX) const = 0;
+		virtual std::string_view view (size_t from, size_t to, std::string& scratch) const = 0;
 		virtual bool visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const = 0;
 		virtual size_t begin (size_t n) const = 0;
 		virtual size_t eol (size_t n) const = 0;
@@ -76,8 +82,30 @@ namespace ng
 		virtual text::indent_t indent () const = 0;
 		virtual scope::context_t scope (size_t i, bool includeDynamic = true) const = 0;
 		virtual std::map<size_t, scope::scope_t> scopes (size_t from, size_t to) const = 0;
+
+		// Line n without the newline. No copy is made when the line is stored contiguously, otherwise it is copied to scratch which can be reused for the next line. The view is invalidated by edits.
+		std::string_view line_view (size_t n, std::string& scratch) const { return view(begin(n), eol(n), scratch); }
 	};
 
+	// Immutable view of the text at a given revision which can be read from any thread. Taking a snapshot copies one tree node per storage chunk, the bytes are shared with the buffer.
+	struct snapshot_t
+	{
+		snapshot_t (detail::storage_t const& storage, size_t revision) : _storage(storage), _revision(revision) { }
+
+		size_t size () const     { return _storage.size(); }
+		size_t revision () const { return _revision; }
+
+		std::string substr (size_t from, size_t to) const { return _storage.substr(from, to); }
+		std::string_view view (size_t from, size_t to, std::string& scratch) const { return _storage.view(from, to, scratch); }
+		bool visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const;
+
+	private:
+		detail::storage_t const _storage;
+		size_t _revision;
+	};
+
+	typedef std::shared_ptr<snapshot_t const> snapshot_ptr;
+
 	struct buffer_t : buffer_api_t
 	{
 		buffer_t ();
@@ -95,9 +123,11 @@ namespace ng
 		std::string operator[] (size_t i) const;
 		std::string substr (size_t from, size_t to) const;
 		std::string xml_substr (size_t from = 0, size_t to = SIZE_T_MAX) const;
+		std::string_view view (size_t from, size_t to, std::string& scratch) const;
 		bool visit_data (std::function<void(char const*, size_t, size_t, bool*)> const& f) const;
 
 		detail::storage_t const& storage () const { return _storage; }
+		snapshot_ptr snapshot () const            { return std::make_shared<snapshot_t>(_storage, _revision); }
 
 		bool operator== (buffer_t const& rhs) const;
 
@@ -108,6 +138,12 @@ namespace ng
 		size_t insert (size_t i, std::string const& str)                { return replace(i, i, str.data(), str.size()); }
 		size_t erase (size_t from, size_t to)                           { return replace(from, to, nullptr, 0); }
 
+		// Insert bytes without copying them, owner must keep the bytes alive and unchanged for as long as the buffer references them
+		size_t insert (size_t i, char const* buf, size_t len, std::shared_ptr<void const> const& owner) { return actual_replace(i, i, buf, len, owner); }
+
+		// Apply non-overlapping replacements (given in original coordinates) as one edit: storage is rewritten once and callbacks see a single replace spanning all ranges
+		size_t replace (std::multimap<std::pair<size_t, size_t>, std::string> const& replacements);
+
 		size_t begin (size_t n) const                { ASSERT_LT(n, lines()); return n   ==       0 ?      0 : _hardlines.nth(n-1)->first + 1; }
 		size_t eol (size_t n) const                  { ASSERT_LT(n, lines()); return n+1 == lines() ? size() : _hardlines.nth(n)->first;       }
 		size_t end (size_t n) const                  { ASSERT_LT(n, lines()); return n+1 == lines() ? size() : _hardlines.nth(n)->first + 1;   }
@@ -156,6 +192,26 @@ namespace ng
 		bool async_parsing () const        { return _async_parsing; }
 		void set_async_parsing (bool flag) { _async_parsing = flag; }
 
+		// Each background parse job handles a run of lines up to this many bytes and stops early if it exceeds the time limit (seconds)
+		void set_parser_budget (size_t bytes, double seconds) { _parser_batch_bytes = bytes; _parser_batch_duration = seconds; }
+
+		// Layouts showing the buffer register themselves so that its parse jobs are scheduled ahead of jobs for buffers which are not on screen
+		void add_viewer ()    { ++_viewers; }
+		void remove_viewer () { --_viewers; }
+
+		// Range to parse first when it is far from where the background parser has reached, e.g. the visible lines after jumping to the end of a newly opened document
+		void set_priority_range (size_t from, size_t to);
+
+		// In a buffer of at least this many bytes, text the parser has not yet reached (e.g. after setting the grammar) is parsed in windows of chunks parsed concurrently from a guessed state, see schedule_speculative_parse() in parsing.cc (SIZE_T_MAX to disable)
+		void set_speculative_parse_threshold (size_t bytes)    { _speculative_parse_threshold = bytes; }
+
+		// Heap usage of the text, each index, and all meta data (symbols, marks, pairs, spelling)
+		memory_usage_t memory_usage () const;
+
+		// Editing splits the text into many small chunks, with async parsing enabled these are merged in slices once editing has paused
+		detail::storage_t::fragmentation_t fragmentation () const { return _storage.fragmentation(); }
+		void compact ()                                           { _storage.compact(0); }
+
 		// ============
 		// = Callback =
 		// ============
@@ -165,7 +221,7 @@ namespace ng
 
 	private:
 		friend struct undo_manager_t;
-		void set_revision (size_t newRevision) { ASSERT_LT(newRevision, _next_revision); _revision = newRevision; initiate_repair(20); }
+		void set_revision (size_t newRevision) { ASSERT_LT(newRevision, _next_revision); _revision = newRevision; initiate_repair(); }
 		char at (size_t i) const;
 
 		void did_parse (size_t first, size_t last)
@@ -200,18 +256,40 @@ namespace ng
 		void add_meta_data (meta_data_t* hook)      { if(hook) _meta_data.push_back(hook); }
 		void remove_meta_data (meta_data_t* hook)   { if(hook) _meta_data.erase(std::find(_meta_data.begin(), _meta_data.end(), hook)); }
 
-		size_t actual_replace (size_t from, size_t to, char const* buf, size_t len);
+		size_t actual_replace (size_t from, size_t to, char const* buf, size_t len, std::shared_ptr<void const> const& owner = std::shared_ptr<void const>());
+		void update_indices (size_t from, size_t to, char const* buf, size_t len);
 
 		uint32_t code_point (size_t& i, size_t& len) const;
 		friend std::string to_s (buffer_t const& buf, size_t first, size_t last);
 
 		text::indent_t _indent;
-		void initiate_repair (size_t limit_redraw = 0, size_t super_from = -1);
-		void update_scopes (size_t limit_redraw, size_t super_range, std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes, parse::stack_ptr parserState);
+		void initiate_repair ();
+		std::vector<repair_line_t> lines_to_repair (size_t n, size_t byteLimit) const;
+		void set_scopes (std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes);
+		void update_scopes (std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes, parse::stack_ptr parserState);
 
 		std::shared_ptr<bool> _parser_reference;
 		bool _async_parsing = false;
 		bool _parser_running = false;
+		size_t _parser_batch_bytes = 64*1024;
+		double _parser_batch_duration = 0.015;
+		size_t _speculative_parse_threshold = 1024*1024;
+		bool _speculation_failed = false; // a chunk parsed from the seed state did not reach the state of the text before it (e.g. a JSON document that is one big object) so validation parsed it twice, we stop speculating until the grammar is set again
+		std::pair<size_t, size_t> _priority_range = { 0, 0 };
+		bool _priority_pending = false;
+		size_t _viewers = 0;
+
+		// A long line which the previous parse job stopped in the middle of, continued by the next job when the line and the parser state at its start are unchanged. Edits before the line move it, edits touching it discard the progress.
+		struct line_progress_t
+		{
+			parse::line_progress_ptr progress;
+			size_t position = SIZE_T_MAX; // start of the line
+			size_t eol = SIZE_T_MAX;
+			parse::stack_ptr state;
+		};
+		line_progress_t _line_progress;
+
+		bool speculative_parse (size_t from) const; // the parser has not reached past from (e.g. the grammar was just set) and the rest is large enough to parse in concurrent chunks
 
 		std::weak_ptr<bool> parser_reference ()
 		{
@@ -220,12 +298,19 @@ namespace ng
 			return _parser_reference;
 		}
 
+		void schedule_compaction (double delay);
+		std::shared_ptr<bool> _compaction_reference = std::make_shared<bool>(true);
+		bool _compaction_scheduled = false;
+		size_t _compaction_offset = 0;
+		size_t _compacted_chunks = 0;
+		size_t _edits = 0;
+
 		size_t _revision, _next_revision;
 		std::string _spelling_language;
 		ns::spelling_tag_t _spelling_tag;
 
 		detail::storage_t                _storage;
-		indexed_map_t<bool>              _hardlines;
+		indexed_btree_t<bool>            _hardlines;
 		indexed_map_t<bool>              _dirty;
 		indexed_map_t<scope::scope_t>    _scopes;
 		indexed_map_t<parse::stack_ptr>  _parser_states;
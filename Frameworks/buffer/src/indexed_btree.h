@@ -0,0 +1,708 @@
+#ifndef INDEXED_BTREE_H_Q4X9T2LM
+#define INDEXED_BTREE_H_Q4X9T2LM
+
+#include <oak/misc.h>
+#include <oak/debug.h>
+
+// =================================================================
+// = Same interface as indexed_map_t but stored in a B+-tree where =
+// = each node holds up to kOrder entries (leaves) or children     =
+// = (inner nodes) in contiguous arrays. A lookup touches a few    =
+// = cache lines per level and there are ~5 levels for 10M entries =
+// = versus ~25 dependent pointer loads for the AA-tree.           =
+// =================================================================
+
+template <typename _ValT = bool>
+struct indexed_btree_t
+{
+private:
+	static size_t const kOrder   = 32;
+	static size_t const kMinimum = kOrder / 4;
+
+	struct node_t
+	{
+		node_t (bool isLeaf) : is_leaf(isLeaf) { }
+		bool is_leaf;
+		size_t count = 0;
+	};
+
+	// Entries are stored as the distance to the previous entry, so an edit only needs to update the entry following it and the aggregated lengths on the path to the root.
+	struct leaf_t : node_t
+	{
+		leaf_t () : node_t(true) { }
+		ssize_t deltas[kOrder];
+		leaf_t* prev = nullptr;
+		leaf_t* next = nullptr;
+		_ValT values[kOrder];
+	};
+
+	// For each child we keep the sum of its deltas and its number of entries.
+	struct inner_t : node_t
+	{
+		inner_t () : node_t(false) { }
+		ssize_t lengths[kOrder];
+		size_t sizes[kOrder];
+		node_t* children[kOrder];
+	};
+
+	node_t* _root   = nullptr;
+	leaf_t* _first  = nullptr;
+	leaf_t* _last   = nullptr;
+	size_t _size    = 0;
+	ssize_t _length = 0; // position of last entry
+
+public:
+	struct iterator : public std::iterator< std::bidirectional_iterator_tag, std::pair<ssize_t, _ValT> >
+	{
+		iterator (indexed_btree_t const* map, leaf_t* leaf, size_t slot, size_t index, ssize_t pos) : _map(map), _leaf(leaf), _slot(slot), _index(index) { _value.first = pos; update_value(); }
+
+		bool operator== (iterator const& rhs) const { return _leaf == rhs._leaf && _slot == rhs._slot; }
+		bool operator!= (iterator const& rhs) const { return !(*this == rhs); }
+		size_t index () const                       { return _index; }
+
+		iterator& operator++ ()
+		{
+			if(++_slot == _leaf->count)
+			{
+				_leaf = _leaf->next;
+				_slot = 0;
+			}
+			if(_leaf)
+				_value.first += _leaf->deltas[_slot];
+			++_index;
+			update_value();
+			return *this;
+		}
+
+		iterator& operator-- ()
+		{
+			if(!_leaf)
+			{
+				_leaf = _map->_last;
+				_slot = _leaf->count;
+				_value.first = _map->_length;
+			}
+			else
+			{
+				_value.first -= _leaf->deltas[_slot];
+			}
+
+			if(_slot-- == 0)
+			{
+				_leaf = _leaf->prev;
+				_slot = _leaf->count - 1;
+			}
+			--_index;
+			update_value();
+			return *this;
+		}
+
+		std::pair<ssize_t, _ValT> const* operator-> () const { return &_value; }
+		std::pair<ssize_t, _ValT> const& operator* () const  { return _value; }
+
+	private:
+		friend struct indexed_btree_t;
+
+		void update_value ()
+		{
+			if(_leaf)
+				_value.second = _leaf->values[_slot];
+		}
+
+		indexed_btree_t const* _map;
+		leaf_t* _leaf;
+		size_t _slot;
+		size_t _index;
+		std::pair<ssize_t, _ValT> _value;
+	};
+
+	indexed_btree_t () { }
+	indexed_btree_t (indexed_btree_t const& rhs)            { *this = rhs; }
+	indexed_btree_t (indexed_btree_t&& rhs)                 { swap(rhs); }
+	~indexed_btree_t ()                                     { clear(); }
+
+	indexed_btree_t& operator= (indexed_btree_t&& rhs)      { clear(); swap(rhs); return *this; }
+	indexed_btree_t& operator= (indexed_btree_t const& rhs)
+	{
+		if(this != &rhs)
+		{
+			std::vector<std::pair<ssize_t, _ValT>> entries(rhs.begin(), rhs.end());
+			clear();
+			assign(entries);
+		}
+		return *this;
+	}
+
+	bool empty () const                      { return _size == 0; }
+	size_t size () const                     { return _size; }
+	size_t number_of_nodes () const          { return count_nodes(_root); }
+	size_t memory_usage () const             { return node_bytes(_root); }
+
+	size_t height () const
+	{
+		size_t res = 0;
+		for(node_t* node = _root; node; node = node->is_leaf ? nullptr : static_cast<inner_t*>(node)->children[0])
+			++res;
+		return res;
+	}
+
+	void swap (indexed_btree_t& rhs)
+	{
+		std::swap(_root,   rhs._root);
+		std::swap(_first,  rhs._first);
+		std::swap(_last,   rhs._last);
+		std::swap(_size,   rhs._size);
+		std::swap(_length, rhs._length);
+	}
+
+	void clear ()
+	{
+		dispose(_root);
+		_root  = nullptr;
+		_first = _last = nullptr;
+		_size  = 0;
+		_length = 0;
+	}
+
+	iterator begin () const                  { return _first ? iterator(this, _first, 0, 0, _first->deltas[0]) : end(); }
+	iterator end () const                    { return iterator(this, nullptr, 0, _size, _length); }
+	iterator lower_bound (ssize_t key) const { return bound(key, false); }
+	iterator upper_bound (ssize_t key) const { return bound(key, true); }
+
+	iterator find (ssize_t key) const
+	{
+		iterator it = lower_bound(key);
+		return it != end() && it->first == key ? it : end();
+	}
+
+	iterator nth (size_t n) const
+	{
+		if(n >= _size)
+			return end();
+
+		node_t* node = _root;
+		size_t index = n;
+		ssize_t offset = 0;
+		while(!node->is_leaf)
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			size_t i = 0;
+			for(; n >= inner->sizes[i]; ++i)
+			{
+				n      -= inner->sizes[i];
+				offset += inner->lengths[i];
+			}
+			node = inner->children[i];
+		}
+
+		leaf_t* leaf = static_cast<leaf_t*>(node);
+		for(size_t i = 0; i <= n; ++i)
+			offset += leaf->deltas[i];
+		return iterator(this, leaf, n, index, offset);
+	}
+
+	void set (ssize_t pos, _ValT const& value)
+	{
+		iterator it = lower_bound(pos);
+		if(it != end() && it->first == pos)
+		{
+			it._leaf->values[it._slot] = value;
+			return;
+		}
+
+		ssize_t const prev = it != end() ? it->first - it._leaf->deltas[it._slot] : _length;
+		size_t const rank  = it.index();
+		insert_at(rank, pos - prev, value);
+		if(rank + 1 < _size)
+			adjust_at(rank + 1, prev - pos);
+	}
+
+	// Replace entries in [from, to) with the sorted (position, value) pairs. When there are many new entries compared to existing ones the tree is rebuilt in linear time instead of inserting each entry.
+	void set_range (ssize_t from, ssize_t to, std::vector<std::pair<ssize_t, _ValT>> const& entries)
+	{
+		ASSERT(entries.empty() || from <= entries.front().first && entries.back().first < to);
+		if(entries.size() * kRebuildRatio < size())
+		{
+			remove(lower_bound(from), lower_bound(to));
+			for(auto const& pair : entries)
+				set(pair.first, pair.second);
+			return;
+		}
+
+		std::vector<std::pair<ssize_t, _ValT>> all;
+		all.reserve(size() + entries.size());
+		for(auto it = begin(); it != end() && it->first < from; ++it)
+			all.push_back(*it);
+		all.insert(all.end(), entries.begin(), entries.end());
+		for(auto it = lower_bound(to); it != end(); ++it)
+			all.push_back(*it);
+
+		clear();
+		assign(all);
+	}
+
+	void remove (ssize_t pos)
+	{
+		iterator it = find(pos);
+		if(it != end())
+			erase_range(it.index(), it.index() + 1);
+		ASSERT(find(pos) == end());
+	}
+
+	void remove (iterator first, iterator last)
+	{
+		erase_range(first.index(), last.index());
+	}
+
+	void replace (ssize_t from, ssize_t to, size_t newLength, bool bindRight = true)
+	{
+		iterator it = bindRight ? lower_bound(to) : upper_bound(to);
+		if(it != end())
+			adjust_at(it.index(), newLength);
+
+		if(bindRight)
+				remove(lower_bound(from), lower_bound(to));
+		else	remove(upper_bound(from), upper_bound(to));
+
+		it = bindRight ? lower_bound(to) : upper_bound(to);
+		if(it != end())
+			adjust_at(it.index(), -(to - from));
+	}
+
+private:
+	static size_t const kRebuildRatio = 16;
+
+	static void dispose (node_t* node)
+	{
+		if(!node)
+			return;
+
+		if(node->is_leaf)
+			return delete static_cast<leaf_t*>(node);
+
+		inner_t* inner = static_cast<inner_t*>(node);
+		for(size_t i = 0; i < inner->count; ++i)
+			dispose(inner->children[i]);
+		delete inner;
+	}
+
+	static size_t count_nodes (node_t* node)
+	{
+		size_t res = node ? 1 : 0;
+		if(node && !node->is_leaf)
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			for(size_t i = 0; i < inner->count; ++i)
+				res += count_nodes(inner->children[i]);
+		}
+		return res;
+	}
+
+	static size_t node_bytes (node_t* node)
+	{
+		size_t res = !node ? 0 : (node->is_leaf ? sizeof(leaf_t) : sizeof(inner_t));
+		if(node && !node->is_leaf)
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			for(size_t i = 0; i < inner->count; ++i)
+				res += node_bytes(inner->children[i]);
+		}
+		return res;
+	}
+
+	static std::pair<ssize_t, size_t> summary (node_t* node)
+	{
+		ssize_t length = 0;
+		size_t size = 0;
+		if(node->is_leaf)
+		{
+			leaf_t* leaf = static_cast<leaf_t*>(node);
+			for(size_t i = 0; i < leaf->count; ++i)
+				length += leaf->deltas[i];
+			size = leaf->count;
+		}
+		else
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			for(size_t i = 0; i < inner->count; ++i)
+			{
+				length += inner->lengths[i];
+				size   += inner->sizes[i];
+			}
+		}
+		return { length, size };
+	}
+
+	iterator bound (ssize_t key, bool upper) const
+	{
+		node_t* node = _root;
+		if(!node || (upper ? _length <= key : _length < key))
+			return end();
+
+		ssize_t offset = 0;
+		size_t index = 0;
+		while(!node->is_leaf)
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			size_t i = 0;
+			for(; i + 1 < inner->count; ++i)
+			{
+				ssize_t const last = offset + inner->lengths[i];
+				if(upper ? key < last : key <= last)
+					break;
+				offset += inner->lengths[i];
+				index  += inner->sizes[i];
+			}
+			node = inner->children[i];
+		}
+
+		leaf_t* leaf = static_cast<leaf_t*>(node);
+		for(size_t i = 0; i < leaf->count; ++i)
+		{
+			offset += leaf->deltas[i];
+			if(upper ? key < offset : key <= offset)
+				return iterator(this, leaf, i, index + i, offset);
+		}
+		return end();
+	}
+
+	// ============================================
+	// = Structural changes addressed by position =
+	// ============================================
+
+	void adjust_at (size_t rank, ssize_t delta)
+	{
+		ASSERT_LT(rank, _size);
+		_length += delta;
+
+		node_t* node = _root;
+		while(!node->is_leaf)
+		{
+			inner_t* inner = static_cast<inner_t*>(node);
+			size_t i = 0;
+			for(; rank >= inner->sizes[i]; ++i)
+				rank -= inner->sizes[i];
+			inner->lengths[i] += delta;
+			node = inner->children[i];
+		}
+		static_cast<leaf_t*>(node)->deltas[rank] += delta;
+	}
+
+	void insert_at (size_t rank, ssize_t delta, _ValT const& value)
+	{
+		if(!_root)
+			_root = _first = _last = new leaf_t;
+
+		if(node_t* sibling = insert(_root, rank, delta, value))
+		{
+			inner_t* root = new inner_t;
+			append_child(root, _root);
+			append_child(root, sibling);
+			_root = root;
+		}
+
+		++_size;
+		_length += delta;
+	}
+
+	// Returns the new right sibling if the node had to be split.
+	node_t* insert (node_t* node, size_t rank, ssize_t delta, _ValT const& value)
+	{
+		if(node->is_leaf)
+		{
+			leaf_t* leaf = static_cast<leaf_t*>(node);
+			leaf_t* sibling = nullptr;
+			if(leaf->count == kOrder)
+			{
+				sibling = split(leaf);
+				if(rank > leaf->count)
+				{
+					rank -= leaf->count;
+					leaf = sibling;
+				}
+			}
+
+			std::move_backward(leaf->deltas + rank, leaf->deltas + leaf->count, leaf->deltas + leaf->count + 1);
+			std::move_backward(leaf->values + rank, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+			leaf->deltas[rank] = delta;
+			leaf->values[rank] = value;
+			++leaf->count;
+			return sibling;
+		}
+
+		inner_t* inner = static_cast<inner_t*>(node);
+		size_t i = 0;
+		for(; i + 1 < inner->count && rank > inner->sizes[i]; ++i)
+			rank -= inner->sizes[i];
+
+		node_t* child = inner->children[i];
+		node_t* childSibling = insert(child, rank, delta, value);
+		inner->lengths[i] += delta;
+		inner->sizes[i]   += 1;
+		if(!childSibling)
+			return nullptr;
+
+		auto const moved = summary(childSibling);
+		inner->lengths[i] -= moved.first;
+		inner->sizes[i]   -= moved.second;
+
+		inner_t* sibling = nullptr;
+		if(inner->count == kOrder)
+		{
+			sibling = split(inner);
+			if(i >= inner->count)
+			{
+				i -= inner->count;
+				inner = sibling;
+			}
+		}
+		insert_child(inner, i + 1, childSibling, moved);
+		return sibling;
+	}
+
+	leaf_t* split (leaf_t* leaf)
+	{
+		leaf_t* sibling = new leaf_t;
+		size_t const keep = leaf->count / 2;
+		std::move(leaf->deltas + keep, leaf->deltas + leaf->count, sibling->deltas);
+		std::move(leaf->values + keep, leaf->values + leaf->count, sibling->values);
+		sibling->count = leaf->count - keep;
+		leaf->count    = keep;
+
+		sibling->prev = leaf;
+		sibling->next = leaf->next;
+		(leaf->next ? leaf->next->prev : _last) = sibling;
+		leaf->next = sibling;
+		return sibling;
+	}
+
+	static inner_t* split (inner_t* inner)
+	{
+		inner_t* sibling = new inner_t;
+		size_t const keep = inner->count / 2;
+		std::move(inner->lengths  + keep, inner->lengths  + inner->count, sibling->lengths);
+		std::move(inner->sizes    + keep, inner->sizes    + inner->count, sibling->sizes);
+		std::move(inner->children + keep, inner->children + inner->count, sibling->children);
+		sibling->count = inner->count - keep;
+		inner->count   = keep;
+		return sibling;
+	}
+
+	static void append_child (inner_t* inner, node_t* child)
+	{
+		insert_child(inner, inner->count, child, summary(child));
+	}
+
+	static void insert_child (inner_t* inner, size_t i, node_t* child, std::pair<ssize_t, size_t> const& info)
+	{
+		ASSERT_LT(inner->count, kOrder);
+		std::move_backward(inner->lengths  + i, inner->lengths  + inner->count, inner->lengths  + inner->count + 1);
+		std::move_backward(inner->sizes    + i, inner->sizes    + inner->count, inner->sizes    + inner->count + 1);
+		std::move_backward(inner->children + i, inner->children + inner->count, inner->children + inner->count + 1);
+		inner->lengths[i]  = info.first;
+		inner->sizes[i]    = info.second;
+		inner->children[i] = child;
+		++inner->count;
+	}
+
+	// Removing an entry adds its delta to the following entry so that positions after it are unchanged.
+	void erase_range (size_t first, size_t last)
+	{
+		for(; first < last; --last)
+		{
+			ssize_t const delta = erase_at(first);
+			if(first < _size)
+				adjust_at(first, delta);
+		}
+	}
+
+	ssize_t erase_at (size_t rank)
+	{
+		ASSERT_LT(rank, _size);
+		ssize_t const delta = erase(_root, rank);
+		--_size;
+		_length -= delta;
+
+		if(_root->is_leaf && _root->count == 0)
+		{
+			delete static_cast<leaf_t*>(_root);
+			_root  = nullptr;
+			_first = _last = nullptr;
+		}
+
+		while(_root && !_root->is_leaf && _root->count == 1)
+		{
+			inner_t* root = static_cast<inner_t*>(_root);
+			_root = root->children[0];
+			delete root;
+		}
+		return delta;
+	}
+
+	// Returns the delta of the removed entry.
+	ssize_t erase (node_t* node, size_t rank)
+	{
+		if(node->is_leaf)
+		{
+			leaf_t* leaf = static_cast<leaf_t*>(node);
+			ssize_t const delta = leaf->deltas[rank];
+			std::move(leaf->deltas + rank + 1, leaf->deltas + leaf->count, leaf->deltas + rank);
+			std::move(leaf->values + rank + 1, leaf->values + leaf->count, leaf->values + rank);
+			leaf->values[--leaf->count] = _ValT();
+			return delta;
+		}
+
+		inner_t* inner = static_cast<inner_t*>(node);
+		size_t i = 0;
+		for(; rank >= inner->sizes[i]; ++i)
+			rank -= inner->sizes[i];
+
+		ssize_t const delta = erase(inner->children[i], rank);
+		inner->lengths[i] -= delta;
+		inner->sizes[i]   -= 1;
+		if(inner->children[i]->count < kMinimum && inner->count > 1)
+			rebalance(inner, i + 1 < inner->count ? i : i - 1);
+		return delta;
+	}
+
+	// Merge or redistribute children i and i+1 of inner.
+	void rebalance (inner_t* inner, size_t i)
+	{
+		node_t* left  = inner->children[i];
+		node_t* right = inner->children[i+1];
+		size_t const total = left->count + right->count;
+		size_t const keep  = total <= kOrder ? total : total / 2;
+
+		if(left->is_leaf)
+		{
+			leaf_t* l = static_cast<leaf_t*>(left);
+			leaf_t* r = static_cast<leaf_t*>(right);
+			if(l->count < keep)
+			{
+				size_t const n = keep - l->count;
+				std::move(r->deltas, r->deltas + n, l->deltas + l->count);
+				std::move(r->values, r->values + n, l->values + l->count);
+				std::move(r->deltas + n, r->deltas + r->count, r->deltas);
+				std::move(r->values + n, r->values + r->count, r->values);
+			}
+			else
+			{
+				size_t const n = l->count - keep;
+				std::move_backward(r->deltas, r->deltas + r->count, r->deltas + r->count + n);
+				std::move_backward(r->values, r->values + r->count, r->values + r->count + n);
+				std::move(l->deltas + keep, l->deltas + l->count, r->deltas);
+				std::move(l->values + keep, l->values + l->count, r->values);
+			}
+		}
+		else
+		{
+			inner_t* l = static_cast<inner_t*>(left);
+			inner_t* r = static_cast<inner_t*>(right);
+			if(l->count < keep)
+			{
+				size_t const n = keep - l->count;
+				std::move(r->lengths,  r->lengths  + n, l->lengths  + l->count);
+				std::move(r->sizes,    r->sizes    + n, l->sizes    + l->count);
+				std::move(r->children, r->children + n, l->children + l->count);
+				std::move(r->lengths  + n, r->lengths  + r->count, r->lengths);
+				std::move(r->sizes    + n, r->sizes    + r->count, r->sizes);
+				std::move(r->children + n, r->children + r->count, r->children);
+			}
+			else
+			{
+				size_t const n = l->count - keep;
+				std::move_backward(r->lengths,  r->lengths  + r->count, r->lengths  + r->count + n);
+				std::move_backward(r->sizes,    r->sizes    + r->count, r->sizes    + r->count + n);
+				std::move_backward(r->children, r->children + r->count, r->children + r->count + n);
+				std::move(l->lengths  + keep, l->lengths  + l->count, r->lengths);
+				std::move(l->sizes    + keep, l->sizes    + l->count, r->sizes);
+				std::move(l->children + keep, l->children + l->count, r->children);
+			}
+		}
+
+		right->count = total - keep;
+		left->count  = keep;
+
+		if(right->count == 0)
+		{
+			if(right->is_leaf)
+			{
+				leaf_t* r = static_cast<leaf_t*>(right);
+				(r->next ? r->next->prev : _last) = r->prev;
+				r->prev->next = r->next;
+				delete r;
+			}
+			else
+			{
+				delete static_cast<inner_t*>(right);
+			}
+
+			inner->lengths[i] += inner->lengths[i+1];
+			inner->sizes[i]   += inner->sizes[i+1];
+			std::move(inner->lengths  + i + 2, inner->lengths  + inner->count, inner->lengths  + i + 1);
+			std::move(inner->sizes    + i + 2, inner->sizes    + inner->count, inner->sizes    + i + 1);
+			std::move(inner->children + i + 2, inner->children + inner->count, inner->children + i + 1);
+			--inner->count;
+		}
+		else
+		{
+			std::tie(inner->lengths[i],   inner->sizes[i])   = summary(left);
+			std::tie(inner->lengths[i+1], inner->sizes[i+1]) = summary(right);
+		}
+	}
+
+	// ================================
+	// = Building from sorted entries =
+	// ================================
+
+	void assign (std::vector<std::pair<ssize_t, _ValT>> const& entries)
+	{
+		ASSERT(_root == nullptr);
+		if(entries.empty())
+			return;
+
+		std::vector<node_t*> level;
+		size_t const leaves = (entries.size() + kOrder - 1) / kOrder;
+		ssize_t last = 0;
+		for(size_t i = 0, n = 0; i < leaves; ++i)
+		{
+			leaf_t* leaf = new leaf_t;
+			for(size_t end = entries.size() * (i+1) / leaves; n < end; ++n)
+			{
+				leaf->deltas[leaf->count] = entries[n].first - last;
+				leaf->values[leaf->count] = entries[n].second;
+				++leaf->count;
+				last = entries[n].first;
+			}
+
+			if(!level.empty())
+			{
+				leaf->prev = static_cast<leaf_t*>(level.back());
+				leaf->prev->next = leaf;
+			}
+			level.push_back(leaf);
+		}
+
+		_first  = static_cast<leaf_t*>(level.front());
+		_last   = static_cast<leaf_t*>(level.back());
+		_size   = entries.size();
+		_length = last;
+
+		while(level.size() > 1)
+		{
+			std::vector<node_t*> parents;
+			size_t const count = (level.size() + kOrder - 1) / kOrder;
+			for(size_t i = 0, n = 0; i < count; ++i)
+			{
+				inner_t* inner = new inner_t;
+				for(size_t end = level.size() * (i+1) / count; n < end; ++n)
+					append_child(inner, level[n]);
+				parents.push_back(inner);
+			}
+			level.swap(parents);
+		}
+		_root = level.front();
+	}
+};
+
+#endif /* end of include guard: INDEXED_BTREE_H_Q4X9T2LM */
@@ -25,6 +25,8 @@ private:
 	static int comp_abs (ssize_t key, key_t const& offset, key_t const& node) { return key < offset.length + node.length ? -1 : (key == offset.length + node.length ? 0 : +1); }
 	static int comp_nth (ssize_t key, key_t const& offset, key_t const& node) { return key < offset.number_of_children ? -1 : (key == offset.number_of_children ? 0 : +1); }
 
+	static size_t const kRebuildRatio = 16; // inserting an entry costs about as much as rebuilding this many nodes
+
 	typedef oak::basic_tree_t<key_t, _ValT> tree_t;
 	mutable tree_t _tree; // this is made mutable because the type doesn’t have const versions of find, {upper,lower}_bound, and begin/end.
 
@@ -76,6 +78,7 @@ public:
 	size_t size () const                     { return _tree.aggregated().number_of_children; }
 	size_t number_of_nodes () const          { return _tree.size(); }
 	size_t height () const                   { return _tree.height(); }
+	size_t memory_usage () const             { return _tree.memory_usage(); }
 
 	iterator begin () const                  { return iterator(_tree, _tree.begin());                     }
 	iterator end () const                    { return iterator(_tree, _tree.end());                       }
@@ -110,6 +113,37 @@ public:
 		_tree.insert(it, pos, value);
 	}
 
+	// Replace entries in [from, to) with the sorted (position, value) pairs. When there are many new entries compared to existing ones the tree is rebuilt in linear time instead of inserting each entry.
+	void set_range (ssize_t from, ssize_t to, std::vector<std::pair<ssize_t, _ValT>> const& entries)
+	{
+		ASSERT(entries.empty() || from <= entries.front().first && entries.back().first < to);
+		if(entries.size() * kRebuildRatio < size())
+		{
+			remove(lower_bound(from), lower_bound(to));
+			for(auto const& pair : entries)
+				set(pair.first, pair.second);
+			return;
+		}
+
+		std::vector<std::pair<key_t, _ValT>> nodes;
+		nodes.reserve(size() + entries.size());
+
+		ssize_t last = 0;
+		auto append = [&](ssize_t pos, _ValT const& value){
+			nodes.emplace_back(key_t(pos - last), value);
+			last = pos;
+		};
+
+		for(auto it = begin(); it != end() && it->first < from; ++it)
+			append(it->first, it->second);
+		for(auto const& pair : entries)
+			append(pair.first, pair.second);
+		for(auto it = lower_bound(to); it != end(); ++it)
+			append(it->first, it->second);
+
+		_tree.assign(nodes.begin(), nodes.end());
+	}
+
 	void remove (ssize_t pos)
 	{
 		auto it = _tree.find(pos, &comp_abs);
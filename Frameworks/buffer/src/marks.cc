@@ -15,6 +15,17 @@ namespace ng
 		}
 	}
 
+	void marks_t::memory_usage (memory_usage_t& usage) const
+	{
+		for(auto const& m : _marks)
+		{
+			size_t bytes = m.second.memory_usage() + heap_size(m.first);
+			for(auto const& pair : m.second)
+				bytes += heap_size(pair.second);
+			usage.add("marks (" + m.first + ")", bytes, m.second.size());
+		}
+	}
+
 	void marks_t::set (size_t index, std::string const& markType, std::string const& value)
 	{
 		_marks[markType].set(index, value);
@@ -0,0 +1,29 @@
+#include "memory_usage.h"
+#include <text/format.h>
+
+namespace ng
+{
+	size_t memory_usage_t::bytes () const
+	{
+		size_t res = 0;
+		for(auto const& entry : entries)
+			res += entry.bytes;
+		return res;
+	}
+
+	size_t heap_size (std::string const& str)
+	{
+		char const* first = (char const*)&str;
+		char const* last  = first + sizeof(str);
+		return first <= str.data() && str.data() < last ? 0 : str.capacity() + 1;
+	}
+
+	std::string to_s (memory_usage_t const& usage)
+	{
+		std::string res;
+		for(auto const& entry : usage.entries)
+			res += text::format("%-24s %12zu bytes %10zu nodes\n", entry.name.c_str(), entry.bytes, entry.nodes);
+		return res + text::format("%-24s %12zu bytes\n", "total", usage.bytes());
+	}
+
+} /* ng */
@@ -0,0 +1,30 @@
+#ifndef BUFFER_MEMORY_USAGE_H_R7KD2WQX
+#define BUFFER_MEMORY_USAGE_H_R7KD2WQX
+
+namespace ng
+{
+	// Approximate heap usage per data structure, sizes are what was allocated (including unused capacity) and nodes count allocations or entries depending on the structure.
+	struct memory_usage_t
+	{
+		struct entry_t
+		{
+			std::string name;
+			size_t bytes;
+			size_t nodes;
+		};
+
+		void add (std::string const& name, size_t bytes, size_t nodes) { entries.push_back({ name, bytes, nodes }); }
+		void add (memory_usage_t const& other)                         { entries.insert(entries.end(), other.entries.begin(), other.entries.end()); }
+		size_t bytes () const;
+
+		std::vector<entry_t> entries;
+	};
+
+	// Bytes allocated outside the string object, i.e. zero when the small string optimization applies
+	size_t heap_size (std::string const& str);
+
+	std::string to_s (memory_usage_t const& usage);
+
+} /* ng */
+
+#endif /* end of include guard: BUFFER_MEMORY_USAGE_H_R7KD2WQX */
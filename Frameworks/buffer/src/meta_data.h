@@ -20,6 +20,7 @@ namespace ng
 	private:
 		void replace (buffer_t* buffer, size_t from, size_t to, size_t len);
 		void did_parse (buffer_t const* buffer, size_t from, size_t to);
+		void memory_usage (memory_usage_t& usage) const;
 
 		typedef indexed_map_t<bool> tree_t;
 		tree_t _misspellings;    // true = misspelled, false = proper
@@ -34,6 +35,7 @@ namespace ng
 	private:
 		void replace (buffer_t* buffer, size_t from, size_t to, size_t len);
 		void did_parse (buffer_t const* buffer, size_t from, size_t to);
+		void memory_usage (memory_usage_t& usage) const;
 
 		typedef indexed_map_t<std::string> tree_t;
 		tree_t _symbols;
@@ -54,6 +56,7 @@ namespace ng
 	private:
 		void replace (buffer_t* buffer, size_t from, size_t to, size_t len);
 		using meta_data_t::did_parse;
+		void memory_usage (memory_usage_t& usage) const;
 
 		typedef indexed_map_t<std::string> tree_t;
 		std::map<std::string, tree_t> _marks;
@@ -35,6 +35,11 @@ namespace ng
 		_pairs.replace(from, to, len);
 	}
 
+	void pairs_t::memory_usage (memory_usage_t& usage) const
+	{
+		usage.add("pairs", _pairs.memory_usage(), _pairs.size());
+	}
+
 	void pairs_t::add_pair (size_t firstIndex, size_t lastIndex)
 	{
 		_pairs.set(firstIndex, _rank++);
@@ -0,0 +1,101 @@
+#include "parse_scheduler.h"
+
+namespace ng
+{
+	parse_scheduler_t::parse_scheduler_t (size_t maximumWorkers, size_t maximumBackgroundWorkers) : _maximum_workers(std::max<size_t>(maximumWorkers, 1)), _maximum_background_workers(std::clamp<size_t>(maximumBackgroundWorkers, 1, _maximum_workers))
+	{
+	}
+
+	parse_scheduler_t::~parse_scheduler_t ()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_statistics.cancelled += _foreground.size() + _background.size();
+		_statistics.queued = 0;
+		_foreground.clear();
+		_background.clear();
+		_idle.wait(lock, [this](){ return _workers == 0; });
+	}
+
+	parse_scheduler_t& parse_scheduler_t::shared ()
+	{
+		// Leave a core for the main thread and let background documents use at most half of the workers
+		static size_t const workers = std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+		static parse_scheduler_t* instance = new parse_scheduler_t(workers, (workers + 1) / 2); // never destroyed so that exit() does not wait for running jobs
+		return *instance;
+	}
+
+	void parse_scheduler_t::submit (std::weak_ptr<bool> const& owner, bool foreground, std::function<void()> const& job)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		(foreground ? _foreground : _background).push_back({ owner, job, std::chrono::steady_clock::now() });
+		++_statistics.queued;
+		start_workers();
+	}
+
+	parse_scheduler_t::statistics_t parse_scheduler_t::statistics () const
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _statistics;
+	}
+
+	// Caller must hold _mutex
+	void parse_scheduler_t::start_workers ()
+	{
+		size_t runnable = _foreground.size() + std::min(_background.size(), _maximum_background_workers - std::min(_running_background, _maximum_background_workers));
+		for(; _workers < _maximum_workers && _workers < _statistics.running + runnable; ++_workers)
+		{
+			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+				run_worker();
+			});
+		}
+	}
+
+	// Caller must hold _mutex
+	bool parse_scheduler_t::next_job (job_t& job, bool& foreground)
+	{
+		while(!_foreground.empty() || (!_background.empty() && _running_background < _maximum_background_workers))
+		{
+			foreground = !_foreground.empty();
+			std::deque<job_t>& queue = foreground ? _foreground : _background;
+			job = std::move(queue.front());
+			queue.pop_front();
+			--_statistics.queued;
+
+			if(!job.owner.expired())
+				return true;
+			++_statistics.cancelled;
+		}
+		return false;
+	}
+
+	void parse_scheduler_t::run_worker ()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		job_t job;
+		bool foreground;
+		while(next_job(job, foreground))
+		{
+			double const latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - job.submitted).count();
+			_statistics.total_latency  += latency;
+			_statistics.maximum_latency = std::max(_statistics.maximum_latency, latency);
+			++_statistics.running;
+			if(!foreground)
+				++_running_background;
+
+			lock.unlock();
+			job.run();
+			job.run = nullptr; // release captured state before taking the lock
+			lock.lock();
+
+			--_statistics.running;
+			++_statistics.completed;
+			if(!foreground)
+				--_running_background;
+		}
+
+		if(--_workers == 0)
+			_idle.notify_all();
+	}
+
+} /* ng */
@@ -0,0 +1,56 @@
+#ifndef BUFFER_PARSE_SCHEDULER_H_3QW8ZK4N
+#define BUFFER_PARSE_SCHEDULER_H_3QW8ZK4N
+
+#include <chrono>
+#include <condition_variable>
+
+namespace ng
+{
+	// Runs parse jobs from all buffers on a bounded number of workers. Jobs for visible buffers run before those for buffers in the background, which may only occupy some of the workers, and a job is dropped without running if its owner has expired (the buffer was closed or the job superseded).
+	struct parse_scheduler_t
+	{
+		struct statistics_t
+		{
+			size_t queued = 0;          // jobs waiting to run
+			size_t running = 0;         // jobs currently running
+			size_t completed = 0;       // jobs run since launch
+			size_t cancelled = 0;       // jobs dropped because their owner expired
+			double total_latency = 0;   // seconds from submit until start, summed over completed jobs
+			double maximum_latency = 0; // longest time a completed job waited to start
+		};
+
+		parse_scheduler_t (size_t maximumWorkers, size_t maximumBackgroundWorkers);
+		~parse_scheduler_t (); // drops queued jobs and waits for running jobs to finish
+		static parse_scheduler_t& shared ();
+
+		void submit (std::weak_ptr<bool> const& owner, bool foreground, std::function<void()> const& job);
+		size_t maximum_workers () const { return _maximum_workers; }
+		statistics_t statistics () const;
+
+	private:
+		struct job_t
+		{
+			std::weak_ptr<bool> owner;
+			std::function<void()> run;
+			std::chrono::steady_clock::time_point submitted;
+		};
+
+		void start_workers ();
+		void run_worker ();
+		bool next_job (job_t& job, bool& foreground);
+
+		size_t const _maximum_workers;
+		size_t const _maximum_background_workers;
+
+		mutable std::mutex _mutex;
+		std::condition_variable _idle;
+		std::deque<job_t> _foreground;
+		std::deque<job_t> _background;
+		size_t _workers = 0;
+		size_t _running_background = 0;
+		statistics_t _statistics;
+	};
+
+} /* ng */
+
+#endif /* end of include guard: BUFFER_PARSE_SCHEDULER_H_3QW8ZK4N */
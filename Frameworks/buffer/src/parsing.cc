@@ -1,5 +1,8 @@
 #include "buffer.h"
 #include "meta_data.h"
+#include "parse_scheduler.h"
+#include <oak/duration.h>
+#include <atomic>
 
 namespace ng
 {
@@ -7,89 +10,388 @@ namespace ng
 	// = buffer_parser_t =
 	// ===================
 
+	struct repair_line_t
+	{
+		size_t from, to;        // relative to the text sent with the request
+		bool dirty;             // line has pending changes and must be parsed
+		parse::stack_ptr state; // parser state at end of line prior to this request
+	};
+
 	struct result_t
 	{
+		size_t from, to;
 		parse::stack_ptr state;
 		std::map<size_t, scope::scope_t> scopes;
 	};
 
-	result_t handle_request (parse::grammar_ptr grammar, parse::stack_ptr state, std::string const& line, std::pair<size_t, size_t> range)
+	static size_t const kLongLineStepBytes = 16*1024;
+
+	// Parse a line in steps of kLongLineStepBytes, checking between steps whether the job was cancelled (its owner expired), in which case nullptr is returned
+	static parse::stack_ptr parse_line (char const* first, char const* last, parse::stack_ptr state, std::map<size_t, scope::scope_t>& scopes, bool firstLine, std::weak_ptr<bool> const& owner)
+	{
+		parse::stack_ptr res;
+		parse::line_progress_ptr progress;
+		while(!(res = parse::parse(first, last, state, scopes, firstLine, kLongLineStepBytes, progress)))
+		{
+			if(owner.expired())
+				break;
+		}
+		return res;
+	}
+
+	// Parse lines until we run out of lines, run out of time, the job is cancelled, or the parser state converges with the state from last time we parsed the following line (in which case the rest of the document is unaffected). Long lines are parsed in steps so that we can stop in the middle of one when out of time, progress then refers to the line following the returned results and should be passed to the next call.
+	static std::vector<result_t> parse_lines (parse::stack_ptr state, std::string_view text, std::vector<repair_line_t> const& lines, size_t offset, double timeLimit, std::weak_ptr<bool> const& owner, parse::line_progress_ptr& progress)
+	{
+		oak::duration_t timer;
+
+		std::vector<result_t> res;
+		for(size_t i = 0; i < lines.size(); ++i)
+		{
+			result_t result;
+			result.from  = offset + lines[i].from;
+			result.to    = offset + lines[i].to;
+			while(!(result.state = parse::parse(text.data() + lines[i].from, text.data() + lines[i].to, state, result.scopes, result.from == 0, kLongLineStepBytes, progress)))
+			{
+				if(timeLimit < timer.duration() || owner.expired())
+					return res;
+			}
+			state = result.state;
+			res.push_back(std::move(result));
+
+			if(i+1 < lines.size() && !lines[i+1].dirty && parse::equal(state, lines[i].state))
+				break;
+			if(timeLimit < timer.duration() || owner.expired())
+				break;
+		}
+		return res;
+	}
+
+	static size_t const kSpeculativeChunkMinimumBytes = 64*1024;
+	static size_t const kPriorityParseMinimumDistance = 64*1024;
+
+	// Text not yet reached by the parser is parsed speculatively in windows with a chunk for each worker. Each window is published when done, so scopes appear gradually and priority jobs can run before the next window.
+	static size_t speculative_window_bytes ()
+	{
+		return parse_scheduler_t::shared().maximum_workers() * kSpeculativeChunkMinimumBytes;
+	}
+
+	// Split lines into at most one chunk per worker, each of at least kSpeculativeChunkMinimumBytes. Returns the index of the first line in each chunk followed by lines.size().
+	static std::vector<size_t> speculative_chunks (std::vector<repair_line_t> const& lines)
+	{
+		size_t const size = lines.back().to;
+		size_t const chunkCount = std::clamp<size_t>(size / kSpeculativeChunkMinimumBytes, 1, parse_scheduler_t::shared().maximum_workers());
+
+		std::vector<size_t> chunks(1, 0);
+		for(size_t i = 1; i < chunkCount; ++i)
+		{
+			size_t const pos = i * size / chunkCount;
+			size_t const n = std::lower_bound(lines.begin(), lines.end(), pos, [](repair_line_t const& line, size_t pos){ return line.to <= pos; }) - lines.begin();
+			if(chunks.back() < n && n < lines.size())
+				chunks.push_back(n);
+		}
+		chunks.push_back(lines.size());
+		return chunks;
+	}
+
+	// Parse lines [first, last) from state into results. Returns false if cancelled. Caller must hold the grammar lock.
+	static bool parse_chunk (parse::stack_ptr state, std::string_view text, std::vector<repair_line_t> const& lines, size_t first, size_t last, size_t offset, std::vector<result_t>& results, std::weak_ptr<bool> const& owner)
+	{
+		for(size_t n = first; n < last; ++n)
+		{
+			results[n].from  = offset + lines[n].from;
+			results[n].to    = offset + lines[n].to;
+			if(!(results[n].state = state = parse_line(text.data() + lines[n].from, text.data() + lines[n].to, state, results[n].scopes, results[n].from == 0, owner)))
+				return false;
+		}
+		return true;
+	}
+
+	// Chunks after the first are parsed from guess (the grammar’s seed state) so we validate them in order: once the guessed state at the start of a line equals the state we get by parsing on from the previous (validated) chunk, that line and the rest of its chunk are correct, so only the prefix up to that line is parsed again. Sets resynced to false if the first guessed chunk had to be parsed again in full. Returns false if cancelled. Caller must hold the grammar lock.
+	static bool validate_chunks (parse::stack_ptr guess, std::string_view text, std::vector<repair_line_t> const& lines, std::vector<size_t> const& chunks, std::vector<result_t>& results, std::weak_ptr<bool> const& owner, bool& resynced)
+	{
+		resynced = true;
+		for(size_t i = 1; i + 1 < chunks.size(); ++i)
+		{
+			size_t n = chunks[i];
+			parse::stack_ptr actual = results[n-1].state, expected = guess;
+			for(; n < chunks[i+1] && !parse::equal(actual, expected); ++n)
+			{
+				expected = results[n].state;
+				results[n].scopes.clear();
+				if(!(results[n].state = actual = parse_line(text.data() + lines[n].from, text.data() + lines[n].to, actual, results[n].scopes, results[n].from == 0, owner)))
+					return false;
+			}
+
+			if(i == 1 && n == chunks[i+1])
+				resynced = false;
+		}
+		return true;
+	}
+
+	// Parse the chunks of a window concurrently, the first from state and the others from a seed state of their own (parsing modifies the stack it starts from), then validate them. This is for wait_for_repair(), background parsing instead runs each chunk as a job on the parse scheduler (see schedule_speculative_parse). Caller must hold the grammar lock.
+	static std::vector<result_t> parse_speculatively (parse::grammar_ptr grammar, parse::stack_ptr state, std::string_view text, std::vector<repair_line_t> const& lines, std::vector<size_t> const& chunks, size_t offset, std::weak_ptr<bool> const& owner, bool& resynced)
+	{
+		std::vector<result_t> res(lines.size());
+		std::vector<result_t>* results              = &res;
+		std::vector<repair_line_t> const* lineInfo  = &lines;
+		std::vector<size_t> const* firstLine        = &chunks;
+
+		dispatch_apply(chunks.size() - 1, DISPATCH_APPLY_AUTO, ^(size_t i){
+			parse_chunk(i == 0 ? state : grammar->seed(), text, *lineInfo, (*firstLine)[i], (*firstLine)[i+1], offset, *results, owner);
+		});
+
+		validate_chunks(grammar->seed(), text, lines, chunks, res, owner, resynced);
+		return res;
+	}
+
+	struct speculative_window_t
+	{
+		parse::grammar_ptr grammar;
+		parse::stack_ptr state;
+		std::string_view text;
+		std::shared_ptr<void const> text_owner;
+		std::vector<repair_line_t> lines;
+		std::vector<size_t> chunks;
+		size_t offset;
+
+		std::vector<result_t> results;
+		std::atomic<size_t> remaining;
+	};
+
+	// Submit a job for each chunk of the window to the parse scheduler, so the fan-out is bounded by its workers and shares them with other buffers. The job finishing last validates the chunks and calls completion (with resynced from validate_chunks), which is never called if cancelled.
+	static void schedule_speculative_parse (std::shared_ptr<speculative_window_t> const& window, std::weak_ptr<bool> const& owner, bool foreground, std::function<void(std::vector<result_t> const&, bool)> const& completion)
 	{
-		std::lock_guard<std::mutex> lock(grammar->mutex());
+		window->results.resize(window->lines.size());
+		window->remaining = window->chunks.size() - 1;
+
+		for(size_t i = 0; i + 1 < window->chunks.size(); ++i)
+		{
+			parse_scheduler_t::shared().submit(owner, foreground, [=](){
+				std::shared_lock<std::shared_mutex> lock(window->grammar->mutex());
+				if(!parse_chunk(i == 0 ? window->state : window->grammar->seed(), window->text, window->lines, window->chunks[i], window->chunks[i+1], window->offset, window->results, owner))
+					return;
 
-		result_t result;
-		result.state = parse::parse(line.data(), line.data() + line.size(), state, result.scopes, range.first == 0);
-		return result;
+				bool resynced;
+				if(--window->remaining == 0 && validate_chunks(window->grammar->seed(), window->text, window->lines, window->chunks, window->results, owner, resynced))
+					completion(window->results, resynced);
+			});
+		}
+	}
+
+	// The text is a view of the buffer’s storage (or a copy if it spans several chunks) and textOwner keeps those bytes alive while we parse on a background thread
+	static std::vector<result_t> handle_request (parse::grammar_ptr grammar, parse::stack_ptr state, std::string_view text, std::shared_ptr<void const> textOwner, std::vector<repair_line_t> const& lines, size_t offset, double timeLimit, std::weak_ptr<bool> const& owner, parse::line_progress_ptr& progress)
+	{
+		std::shared_lock<std::shared_mutex> lock(grammar->mutex());
+		return parse_lines(state, text, lines, offset, timeLimit, owner, progress);
 	}
 
 	// ============
 	// = buffer_t =
 	// ============
 
-	void buffer_t::initiate_repair (size_t limit_redraw, size_t batch_start)
+	std::vector<repair_line_t> buffer_t::lines_to_repair (size_t n, size_t byteLimit) const
+	{
+		std::vector<repair_line_t> res;
+
+		size_t const from = begin(n);
+		for(; n < lines() && (res.empty() || end(n-1) - from < byteLimit); ++n)
+		{
+			size_t bol = begin(n), eol = end(n);
+			auto dirty = _dirty.lower_bound(bol);
+			auto state = _parser_states.find(eol);
+			res.push_back({ bol - from, eol - from, dirty != _dirty.end() && (size_t)dirty->first < eol, state != _parser_states.end() ? state->second : parse::stack_ptr() });
+		}
+
+		return res;
+	}
+
+	bool buffer_t::speculative_parse (size_t from) const
+	{
+		return !_speculation_failed && _speculative_parse_threshold <= size() && 2*kSpeculativeChunkMinimumBytes <= size() - from && _parser_states.upper_bound(from) == _parser_states.end();
+	}
+
+	void buffer_t::initiate_repair ()
 	{
 		if(!_async_parsing || _parser_running)
 			return;
 
 		if(!_dirty.empty() && !_parser_states.empty())
 		{
-			size_t n       = convert(_dirty.begin()->first).line;
+			size_t n         = convert(_dirty.begin()->first).line;
+			size_t byteLimit = _parser_batch_bytes;
+
+			// When the priority range (what is visible) is far from where the parser has reached we parse it first using the nearest parser state we have. This state may be wrong so the result is provisional: only scopes are updated and the lines are parsed again once the parser reaches them. A speculative parse checks for this between windows, so jumping to the end of a large document does not wait for the whole document to be parsed. If the priority range is on the line the parser has reached (a long line) we leave it to the parser, which continues where it stopped.
+			size_t const priorityFrom = std::min(_priority_range.first, size());
+			size_t const priorityTo   = std::min(_priority_range.second, size());
+			bool provisional          = _priority_pending && _dirty.begin()->first + kPriorityParseMinimumDistance < priorityFrom && convert(priorityFrom).line != n;
+			_priority_pending         = false;
+
+			if(provisional)
+			{
+				n         = convert(priorityFrom).line;
+				byteLimit = priorityTo - begin(n);
+			}
+
 			size_t from    = begin(n);
-			size_t to      = end(n);
+			bool speculate = !provisional && speculative_parse(from);
+			if(speculate)
+				byteLimit = speculative_window_bytes();
+
 			auto stateIter = from == 0 ? _parser_states.begin() : _parser_states.find(from);
-			if(stateIter != _parser_states.end())
+			if(provisional)
 			{
-				if(batch_start == -1)
-					batch_start = from;
+				stateIter = _parser_states.upper_bound(from);
+				--stateIter;
+			}
+
+			// Stop before a long line which a previous job did not finish, so that the next job starts at it and can continue where that job stopped
+			if(!provisional && !speculate && _line_progress.progress && from < _line_progress.position && _line_progress.position - from < byteLimit)
+				byteLimit = _line_progress.position - from;
 
+			if(stateIter != _parser_states.end())
+			{
 				auto grammarRef = grammar();
 				auto state      = stateIter->second;
-				auto line       = substr(from, to);
+				auto batch      = lines_to_repair(n, byteLimit);
+				auto scratch    = std::make_shared<std::string>();
+				auto timeLimit  = _parser_batch_duration;
+
+				// A window with a single chunk, e.g. one long line, is parsed in time limited steps like other jobs
+				std::vector<size_t> chunks;
+				if(speculate)
+					speculate = (chunks = speculative_chunks(batch)).size() > 2;
+
+				// Continue a long line that the previous job did not finish, unless the line or the state it started from has changed since. Unless that line comes after this job, _line_progress instead follows the first line of the job while it runs (moved by update_indices()), so that progress on that line is kept if only other lines are edited. A provisional job parses elsewhere so leaves it for the next job.
+				parse::line_progress_ptr lineProgress;
+				if(!provisional)
+				{
+					if(_line_progress.progress && !speculate && _line_progress.position == from && parse::equal(_line_progress.state, state))
+						lineProgress = _line_progress.progress;
+					if(!_line_progress.progress || _line_progress.position <= from)
+						_line_progress = { parse::line_progress_ptr(), from, eol(n), state };
+				}
+
+				std::shared_ptr<void const> textOwner;
+				std::string_view text = _storage.view(from, from + batch.back().to, *scratch, &textOwner);
+				if(!textOwner)
+					textOwner = scratch;
 
 				size_t bufferRev = revision();
 				auto bufferRef   = parser_reference();
+				bool foreground  = _viewers > 0 || provisional;
 				_parser_running  = true;
 
 				CFRunLoopRef runLoop = CFRunLoopGetCurrent();
-				dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-					result_t result = handle_request(grammarRef, state, line, { from, to });
+				auto didParse = [=, this](std::vector<result_t> results, parse::line_progress_ptr progress, bool resynced){
 					CFRunLoopPerformBlock(runLoop, kCFRunLoopCommonModes, ^{
 						if(bufferRef.lock())
 						{
 							_parser_running = false;
+							if(!resynced)
+								_speculation_failed = true;
+
 							if(bufferRev == revision())
 							{
-								update_scopes(limit_redraw, batch_start, { from, to }, result.scopes, result.state);
+								for(auto const& result : results)
+								{
+									if(provisional)
+											set_scopes({ result.from, result.to }, result.scopes);
+									else	update_scopes({ result.from, result.to }, result.scopes, result.state);
+								}
+
+								if(!results.empty())
+									did_parse(results.front().from, results.back().to);
 							}
-							else
+
+							if(!provisional)
 							{
-								// We didn’t inform anyone about the previous lines parsed
-								if(batch_start != from)
-									did_parse(std::min(batch_start, size()), std::min(from, size()));
-								initiate_repair();
+								bool const followsFirstLine = !_line_progress.progress && _line_progress.position != SIZE_T_MAX;
+								if(bufferRev != revision() && followsFirstLine && !results.empty())
+								{
+									// The buffer was edited but not the first line of this job so its result is still valid, without this a long line that takes several jobs would never be done while something is appended to the buffer
+									size_t const to = _line_progress.position + results.front().to - results.front().from;
+									update_scopes({ _line_progress.position, to }, results.front().scopes, results.front().state);
+									did_parse(_line_progress.position, to);
+								}
+
+								if(progress && bufferRev == revision())
+								{
+									size_t const position = results.empty() ? from : results.back().to;
+									_line_progress = { progress, position, eol(convert(position).line), results.empty() ? state : results.back().state };
+								}
+								else if(progress && results.empty() && followsFirstLine)
+								{
+									_line_progress.progress = progress; // the buffer was edited but not the line we stopped in
+								}
+								else if(followsFirstLine)
+								{
+									_line_progress = { };
+								}
 							}
+							initiate_repair();
 						}
 					});
 					CFRunLoopWakeUp(runLoop);
-				});
+				};
+
+				if(speculate)
+				{
+					auto window = std::make_shared<speculative_window_t>();
+					window->grammar    = grammarRef;
+					window->state      = state;
+					window->text       = text;
+					window->text_owner = textOwner;
+					window->lines      = std::move(batch);
+					window->chunks     = std::move(chunks);
+					window->offset     = from;
+
+					schedule_speculative_parse(window, bufferRef, foreground, [didParse](std::vector<result_t> const& results, bool resynced){
+						didParse(results, parse::line_progress_ptr(), resynced);
+					});
+				}
+				else
+				{
+					parse_scheduler_t::shared().submit(bufferRef, foreground, [=](){
+						parse::line_progress_ptr progress = lineProgress;
+						std::vector<result_t> results = handle_request(grammarRef, state, text, textOwner, batch, from, timeLimit, bufferRef, progress);
+						didParse(std::move(results), progress, true);
+					});
+				}
 			}
 			else
 			{
-				os_log_error(OS_LOG_DEFAULT, "No parser state for %zu-%zu (%p)\n%{public}s\n%{public}s", from, to, this, substr(0, size()).c_str(), to_s(*this).c_str());
+				os_log_error(OS_LOG_DEFAULT, "No parser state for %zu (%p)\n%{public}s\n%{public}s", from, this, substr(0, size()).c_str(), to_s(*this).c_str());
 			}
 		}
 	}
 
-	void buffer_t::update_scopes (size_t limit_redraw, size_t batch_start, std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes, parse::stack_ptr parserState)
+	void buffer_t::set_priority_range (size_t from, size_t to)
+	{
+		if(_priority_range == std::make_pair(from, to))
+			return;
+
+		_priority_range   = { from, to };
+		_priority_pending = from < to;
+		initiate_repair();
+	}
+
+	void buffer_t::set_scopes (std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes)
 	{
 		bool atEOF = convert(range.first).line+1 == lines();
-		_scopes.remove(_scopes.lower_bound(range.first), atEOF ? _scopes.end() : _scopes.lower_bound(range.second));
+		std::vector<std::pair<ssize_t, scope::scope_t>> scopes;
 		for(auto const& pair : newScopes)
 		{
 			if(range.first + pair.first < range.second || atEOF)
-				_scopes.set(range.first + pair.first, pair.second);
+				scopes.emplace_back(range.first + pair.first, pair.second);
 		}
+		_scopes.set_range(range.first, atEOF ? SSIZE_MAX : range.second, scopes);
+	}
+
+	void buffer_t::update_scopes (std::pair<size_t, size_t> const& range, std::map<size_t, scope::scope_t> const& newScopes, parse::stack_ptr parserState)
+	{
+		set_scopes(range, newScopes);
 
+		bool atEOF = convert(range.first).line+1 == lines();
 		_dirty.remove(_dirty.lower_bound(range.first), atEOF ? _dirty.end() : _dirty.lower_bound(range.second));
 		if((_parser_states.find(range.second) == _parser_states.end() || !parse::equal(parserState, (_parser_states.find(range.second)->second))))
 		{
@@ -100,17 +402,6 @@ namespace ng
 
 		_parser_reference.reset();
 		_parser_running = false;
-
-		bool next_line_needs_update = !_dirty.empty() && _dirty.begin()->first == range.second;
-		if(!next_line_needs_update || limit_redraw == 0)
-		{
-			did_parse(batch_start, range.second);
-			initiate_repair(10);
-		}
-		else
-		{
-			initiate_repair(limit_redraw == 0 ? 0 : limit_redraw-1, batch_start);
-		}
 	}
 
 	void buffer_t::wait_for_repair ()
@@ -127,23 +418,32 @@ namespace ng
 		if(_spelling)
 			_spelling->set_disabled(true);
 
-		std::lock_guard<std::mutex> lock(grammar()->mutex());
+		std::string scratch;
+		auto const owner = std::make_shared<bool>(true); // we parse synchronously so this is never cancelled
+		std::shared_lock<std::shared_mutex> lock(grammar()->mutex());
 		while(!_dirty.empty() && !_parser_states.empty())
 		{
 			size_t n    = convert(_dirty.begin()->first).line;
 			size_t from = begin(n);
-			size_t to   = end(n);
 			auto state  = from == 0 ? _parser_states.begin() : _parser_states.find(from);
 			if(state == _parser_states.end())
 			{
-				os_log_error(OS_LOG_DEFAULT, "No parser state for %zu-%zu (%p)\n%{public}s", from, to, this, substr(0, size()).c_str());
+				os_log_error(OS_LOG_DEFAULT, "No parser state for %zu (%p)\n%{public}s", from, this, substr(0, size()).c_str());
 				break;
 			}
 
-			std::string const line = substr(from, to);
-			std::map<size_t, scope::scope_t> newScopes;
-			auto newState = parse::parse(line.data(), line.data() + line.size(), state->second, newScopes, from == 0);
-			update_scopes(0, from, std::make_pair(from, to), newScopes, newState);
+			bool const speculate = speculative_parse(from);
+			auto const batch  = lines_to_repair(n, speculate ? speculative_window_bytes() : _parser_batch_bytes);
+			auto const chunks = speculate ? speculative_chunks(batch) : std::vector<size_t>();
+			std::string_view const text = view(from, from + batch.back().to, scratch);
+			parse::line_progress_ptr progress;
+			bool resynced = true;
+			auto const results = chunks.size() > 2 ? parse_speculatively(grammar(), state->second, text, batch, chunks, from, owner, resynced) : parse_lines(state->second, text, batch, from, DBL_MAX, owner, progress);
+			if(!resynced)
+				_speculation_failed = true;
+			for(auto const& result : results)
+				update_scopes({ result.from, result.to }, result.scopes, result.state);
+			did_parse(results.front().from, results.back().to);
 		}
 
 		if(_spelling)
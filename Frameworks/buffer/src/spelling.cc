@@ -99,6 +99,11 @@ namespace ng
 		_misspellings.replace(from, to, len);
 	}
 
+	void spelling_t::memory_usage (memory_usage_t& usage) const
+	{
+		usage.add("spelling", _misspellings.memory_usage(), _misspellings.size());
+	}
+
 	std::map<size_t, bool> spelling_t::misspellings (buffer_t const* buffer, size_t from, size_t to) const
 	{
 		ASSERT_LE(from, to);
@@ -78,6 +78,19 @@ namespace ng
 			_tree.insert(it, length, memory_t(data, data + length));
 		}
 
+		void storage_t::insert (size_t pos, char const* data, size_t length, std::shared_ptr<void const> const& owner)
+		{
+			ASSERT_LE(pos, size());
+			if(length == 0)
+				return;
+
+			auto it = find_pos(pos);
+			if(it != _tree.end() && it->offset < pos)
+				it = split_at(it, pos - it->offset);
+
+			_tree.insert(it, length, memory_t(data, length, owner));
+		}
+
 		void storage_t::erase (size_t first, size_t last)
 		{
 			ASSERT_LE(first, last); ASSERT_LE(last, size());
@@ -150,6 +163,117 @@ namespace ng
 			return res;
 		}
 
+		std::string_view storage_t::view (size_t first, size_t last, std::string& scratch, std::shared_ptr<void const>* owner) const
+		{
+			ASSERT_LE(first, last); ASSERT_LE(last, size());
+
+			auto it = find_pos(first);
+			if(it != _tree.end() && last <= it->offset + it->key)
+			{
+				if(owner)
+					*owner = it->value.owner();
+				return std::string_view(it->value.bytes() + first - it->offset, last - first);
+			}
+
+			scratch.clear();
+			for(; it != _tree.end() && it->offset < last; ++it)
+			{
+				size_t i = std::max(it->offset, first) - it->offset;
+				size_t j = std::min(it->offset + it->key, last) - it->offset;
+				scratch.append(it->value.bytes() + i, it->value.bytes() + j);
+			}
+			return scratch;
+		}
+
+		void storage_t::memory_usage (memory_usage_t& usage) const
+		{
+			// Chunks split by erase share their helper so only count each once
+			std::set<memory_t::helper_t const*> seen;
+			size_t owned = 0, borrowed = 0, borrowedChunks = 0;
+			for(auto const& node : _tree)
+			{
+				memory_t::helper_t const* helper = node.value.helper();
+				if(!seen.insert(helper).second)
+					continue;
+
+				if(helper->borrowed())
+				{
+					borrowed += helper->size();
+					++borrowedChunks;
+				}
+				else
+				{
+					owned += sizeof(memory_t::helper_t) + helper->capacity();
+				}
+			}
+
+			usage.add("text", owned + _tree.memory_usage(), _tree.size());
+			if(borrowedChunks)
+				usage.add("text (mapped)", borrowed, borrowedChunks);
+		}
+
+		// ==============
+		// = Compaction =
+		// ==============
+
+		static size_t const kSmallChunkSize  = 4*1024;
+		static size_t const kMaxMergedSize   = 64*1024;
+		static size_t const kChunkVisitCost  = 64; // budget charged per chunk visited, in addition to bytes copied
+
+		static bool should_compact (size_t size, memory_t const& memory)
+		{
+			return size < kSmallChunkSize || 4 * size < memory.helper()->capacity();
+		}
+
+		storage_t::fragmentation_t storage_t::fragmentation () const
+		{
+			fragmentation_t res;
+			std::map<memory_t::helper_t const*, size_t> referenced;
+			for(auto const& node : _tree)
+			{
+				++res.chunks;
+				if(should_compact(node.key, node.value))
+					++res.small_chunks;
+				if(!node.value.helper()->borrowed())
+					referenced[node.value.helper()] += node.key;
+			}
+
+			for(auto const& pair : referenced)
+				res.wasted += pair.first->capacity() - std::min(pair.second, pair.first->capacity());
+			return res;
+		}
+
+		size_t storage_t::compact (size_t pos, size_t budget)
+		{
+			size_t cost = 0;
+			auto it = _tree.lower_bound(pos, &comp_abs);
+			while(it != _tree.end() && cost < budget)
+			{
+				auto last = it;
+				size_t runSize = 0, runChunks = 0;
+				for(; last != _tree.end() && should_compact(last->key, last->value) && (runChunks == 0 || runSize + last->key <= kMaxMergedSize); ++last, ++runChunks)
+					runSize += last->key;
+				cost += kChunkVisitCost * std::max<size_t>(runChunks, 1);
+
+				bool const pinsAllocation = runChunks == 1 && it->key < it->value.helper()->capacity() / 4;
+				if(runChunks > 1 || pinsAllocation)
+				{
+					std::string bytes;
+					bytes.reserve(runSize);
+					for(auto chunk = it; chunk != last; ++chunk)
+						bytes.append(chunk->value.bytes(), chunk->key);
+
+					size_t const offset = it->offset;
+					_tree.erase(it, last);
+					it = _tree.insert(_tree.lower_bound(offset, &comp_abs), runSize, memory_t(bytes.data(), bytes.data() + bytes.size()));
+					last = ++it;
+					cost += runSize;
+				}
+				it = runChunks ? last : ++it;
+			}
+			return it != _tree.end() ? it->offset : size();
+		}
+
 	} /* detail */
 
 } /* ng */
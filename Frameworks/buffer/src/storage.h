@@ -1,8 +1,10 @@
 #ifndef BUFFER_H_FCAAENIG
 #define BUFFER_H_FCAAENIG
 
+#include "memory_usage.h"
 #include <oak/basic_tree.h>
 #include <oak/debug.h>
+#include <string_view>
 
 namespace ng
 {
@@ -19,10 +21,14 @@ namespace ng
 					append(first, last);
 				}
 
-				~helper_t ()                         { free(_bytes); }
+				helper_t (char const* bytes, size_t size, std::shared_ptr<void const> const& owner) : _bytes((char*)bytes), _size(size), _owner(owner) { }
+
+				~helper_t ()                         { if(!_owner) free(_bytes); }
 				char const* bytes () const           { return _bytes; }
 				size_t size () const                 { return _size; }
-				size_t available () const            { return malloc_size(_bytes) - _size; }
+				size_t available () const            { return _owner ? 0 : malloc_size(_bytes) - _size; }
+				size_t capacity () const             { return _owner ? 0 : malloc_size(_bytes); }
+				bool borrowed () const               { return _owner ? true : false; }
 
 				template <typename _InputIter>
 				void append (_InputIter first, _InputIter last)
@@ -34,6 +40,7 @@ namespace ng
 			private:
 				char* _bytes;
 				size_t _size = 0;
+				std::shared_ptr<void const> _owner; // set when _bytes is borrowed, e.g. from a mapped file
 			};
 
 			typedef std::shared_ptr<helper_t> helper_ptr;
@@ -42,11 +49,14 @@ namespace ng
 			memory_t (_InputIter first, _InputIter last);
 
 			memory_t () : _offset(0)                          { }
+			memory_t (char const* bytes, size_t size, std::shared_ptr<void const> const& owner) : _helper(std::make_shared<helper_t>(bytes, size, owner)), _offset(0) { }
 			memory_t (helper_ptr const& helper, size_t offset) : _helper(helper), _offset(offset) { }
 			memory_t subset (size_t from)                     { return memory_t(_helper, _offset + from); }
 			char const* bytes () const                        { return _helper->bytes() + _offset; }
 			size_t size () const                              { return _helper->size() - _offset; }
 			size_t available () const                         { return _helper->available(); }
+			helper_t const* helper () const                   { return _helper.get(); }
+			std::shared_ptr<void const> owner () const        { return _helper; }
 
 			template <typename _InputIter>
 			void insert (size_t pos, _InputIter first, _InputIter last);
@@ -107,9 +117,27 @@ namespace ng
 			iterator end () const      { return iterator(_tree.end());   }
 
 			void insert (size_t pos, char const* data, size_t length);
+			// Reference data without copying it, owner must keep the bytes alive and unchanged for as long as they are referenced
+			void insert (size_t pos, char const* data, size_t length, std::shared_ptr<void const> const& owner);
 			void erase (size_t first, size_t last);
 			char operator[] (size_t i) const;
 			std::string substr (size_t first, size_t last) const;
+			// Return [first, last) without copying when it is stored in a single chunk, otherwise copy it to scratch. Bytes are never changed once written to a chunk, so if owner is given and set, the view is valid for as long as owner is alive (also on other threads), else only until the storage is modified.
+			std::string_view view (size_t first, size_t last, std::string& scratch, std::shared_ptr<void const>* owner = nullptr) const;
+			void memory_usage (memory_usage_t& usage) const;
+
+			struct fragmentation_t
+			{
+				size_t chunks = 0;       // number of chunks in the tree
+				size_t small_chunks = 0; // chunks that compact() would merge with their neighbours
+				size_t wasted = 0;       // allocated bytes not referenced by any chunk, e.g. erased text pinned by a split allocation
+			};
+
+			size_t chunks () const     { return _tree.size(); }
+			fragmentation_t fragmentation () const;
+
+			// Copy runs of small chunks (and chunks pinning a much larger allocation) into new allocations, starting with the first chunk at or after pos. Stops once roughly budget bytes of work is done and returns the position to resume from, which is size() when done.
+			size_t compact (size_t pos, size_t budget = SIZE_T_MAX);
 
 		private:
 			typedef oak::basic_tree_t<size_t, memory_t> tree_t;
@@ -97,6 +97,14 @@ namespace ng
 {
 	void symbols_t::replace (buffer_t* buffer, size_t from, size_t to, size_t len) { _symbols.replace(from, to, len); }
 
+	void symbols_t::memory_usage (memory_usage_t& usage) const
+	{
+		size_t bytes = _symbols.memory_usage();
+		for(auto const& pair : _symbols)
+			bytes += heap_size(pair.second);
+		usage.add("symbols", bytes, _symbols.size());
+	}
+
 	void symbols_t::did_parse (buffer_t const* buffer, size_t from, size_t to)
 	{
 		_symbols.remove(_symbols.lower_bound(from), _symbols.lower_bound(to));
@@ -1,9 +1,11 @@
 #import <buffer/buffer.h>
+#import <buffer/parse_scheduler.h>
 #import <text/format.h>
 #import <test/bundle_index.h>
 #import <oak/duration.h>
 
 static bundles::item_ptr TestGrammarItem;
+static bundles::item_ptr TestCommentGrammarItem;
 
 void setup_fixtures ()
 {
@@ -18,8 +20,19 @@ void setup_fixtures ()
 		"	uuid           = '978BF73C-B36D-490F-AEBF-74EF2C6EA7D1';\n"
 		"}\n";
 
+	static std::string TestCommentLanguageGrammar =
+		"{	name           = 'Test Comments';\n"
+		"	patterns       = (\n"
+		"    { name = 'comment'; begin = '/\\*'; end = '\\*/'; },\n"
+		"    { name = 'foo'; match = 'foo'; },\n"
+		"  );\n"
+		"	scopeName      = 'test.comment';\n"
+		"	uuid           = 'C6A1E4D0-5B8F-4E2A-9D3C-7F1B2A8E6D45';\n"
+		"}\n";
+
 	test::bundle_index_t bundleIndex;
 	TestGrammarItem = bundleIndex.add(bundles::kItemTypeGrammar, TestLanguageGrammar);
+	TestCommentGrammarItem = bundleIndex.add(bundles::kItemTypeGrammar, TestCommentLanguageGrammar);
 	bundleIndex.commit();
 
 	NSApplicationLoad();
@@ -40,6 +53,167 @@ void benchmark_insert_50_mb ()
 		buf.insert(buf.size(), tmp);
 }
 
+void benchmark_replace_all_50k ()
+{
+	std::string text;
+	for(size_t i = 0; i < 50000; ++i)
+		text += text::format("%zu: foo(bar, baz) + foobar\n", i);
+
+	std::multimap<std::pair<size_t, size_t>, std::string> replacements;
+	for(size_t pos = text.find("baz"); pos != std::string::npos; pos = text.find("baz", pos + 3))
+		replacements.emplace(std::make_pair(pos, pos + 3), "quux");
+
+	ng::buffer_t serial, batch;
+	serial.insert(0, text);
+	batch.insert(0, text);
+
+	oak::duration_t timer;
+	ssize_t adjustment = 0;
+	for(auto const& pair : replacements)
+	{
+		serial.replace(pair.first.first + adjustment, pair.first.second + adjustment, pair.second);
+		adjustment += pair.second.size() - (pair.first.second - pair.first.first);
+	}
+	double const serialTime = timer.duration();
+
+	timer.reset();
+	batch.replace(replacements);
+	double const batchTime = timer.duration();
+
+	OAK_ASSERT(serial == batch);
+	fprintf(stdout, "%zu replacements: %.3fs one by one, %.3fs as one edit (%.1f× speedup)\n", replacements.size(), serialTime, batchTime, serialTime / batchTime);
+}
+
+void benchmark_load_1m_lines ()
+{
+	std::string text;
+	for(size_t i = 0; i < 1000000; ++i)
+		text += text::format("%zu: foo(bar, baz) + foobar\n", i);
+
+	oak::duration_t timer;
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	fprintf(stdout, "loaded %zu lines (%.1f MB) in %.0f ms\n", buf.lines(), text.size() / 1024.0 / 1024.0, timer.duration() * 1000);
+}
+
+static void async_parse (size_t lineCount, size_t batchBytes)
+{
+	struct callback_t : ng::callback_t
+	{
+		callback_t (ng::buffer_t const& buffer) : buffer(buffer) { }
+		void did_parse (size_t from, size_t to) { done = done || to == buffer.size(); }
+
+		ng::buffer_t const& buffer;
+		bool done = false;
+	};
+
+	std::string text;
+	for(size_t i = 0; i < lineCount; ++i)
+		text += text::format("%zu: foo(bar, baz) + foobar\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_async_parsing(true);
+	buf.set_parser_budget(batchBytes, 0.015);
+
+	callback_t cb(buf);
+	buf.add_callback(&cb);
+
+	oak::duration_t timer;
+	buf.set_grammar(TestGrammarItem);
+	while(!cb.done)
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.05, false);
+	fprintf(stdout, "parsed %zu lines in %.2fs (%.0f lines/s, %zu bytes per job)\n", lineCount, timer.duration(), lineCount / timer.duration(), batchBytes);
+
+	buf.remove_callback(&cb);
+}
+
+void benchmark_async_parse_200k_lines_one_line_per_job ()
+{
+	async_parse(200000, 0);
+}
+
+void benchmark_async_parse_200k_lines_batched ()
+{
+	async_parse(200000, 64*1024);
+}
+
+void benchmark_scope_memory_200k_lines ()
+{
+	std::string text;
+	for(size_t i = 0; i < 200000; ++i)
+		text += text::format("%zu: foo(bar, baz) + foobar\n", i);
+
+	size_t const before = scope::statistics().bytes;
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_grammar(TestGrammarItem);
+	buf.wait_for_repair();
+
+	scope::statistics_t const stats = scope::statistics();
+	fprintf(stdout, "%zu scope nodes using %zu bytes for %zu lines\n", stats.nodes, stats.bytes - before, buf.lines());
+}
+
+void benchmark_line_view_1m_short_lines ()
+{
+	std::string text;
+	for(size_t i = 0; i < 1000000; ++i)
+		text += text::format("%zu: foo\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+
+	size_t total = 0;
+	oak::duration_t timer;
+	for(size_t n = 0; n < buf.lines(); ++n)
+		total += buf.substr(buf.begin(n), buf.eol(n)).size();
+	double const substrTime = timer.duration();
+	timer.reset();
+
+	std::string scratch;
+	for(size_t n = 0; n < buf.lines(); ++n)
+		total -= buf.line_view(n, scratch).size();
+	double const viewTime = timer.duration();
+
+	OAK_ASSERT_EQ(total, 0);
+	fprintf(stdout, "read %zu lines: %.0f ms using substr(), %.0f ms using line_view()\n", buf.lines(), substrTime * 1000, viewTime * 1000);
+}
+
+void benchmark_parse_1m_short_lines ()
+{
+	std::string text;
+	for(size_t i = 0; i < 1000000; ++i)
+		text += text::format("%zu: foo\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+
+	oak::duration_t timer;
+	buf.set_grammar(TestGrammarItem);
+	buf.wait_for_repair();
+	fprintf(stdout, "parsed %zu lines in %.0f ms\n", buf.lines(), timer.duration() * 1000);
+}
+
+void benchmark_speculative_parse_1m_lines ()
+{
+	std::string text;
+	for(size_t i = 0; i < 1000000; ++i)
+		text += text::format(i % 1000 == 0 ? "/* %zu: foo\n" : i % 1000 == 5 ? "%zu: foo */\n" : "%zu: foo(bar, baz) + foobar\n", i);
+
+	for(size_t threshold : { SIZE_T_MAX, size_t(0) })
+	{
+		ng::buffer_t buf;
+		buf.insert(0, text);
+		buf.set_speculative_parse_threshold(threshold);
+
+		oak::duration_t timer;
+		buf.set_grammar(TestCommentGrammarItem);
+		buf.wait_for_repair();
+		fprintf(stdout, "parsed %zu lines %s in %.0f ms\n", buf.lines(), threshold ? "sequentially" : "speculatively", timer.duration() * 1000);
+	}
+}
+
 // void test_copy_constructor ()
 // {
 // 	ng::buffer_t org, dup;
@@ -86,6 +260,374 @@ void test_subset_replace ()
 	buf.remove_callback(&cb);
 }
 
+void test_batch_replace ()
+{
+	struct callback_t : ng::callback_t
+	{
+		void did_replace (size_t from, size_t to, char const* buf, size_t len) { actual.emplace_back(text::format("%zu-%zu: ", from, to) + std::string(buf, len)); }
+		std::vector<std::string> actual;
+	};
+
+	static callback_t cb;
+
+	ng::buffer_t buf;
+	buf.set_grammar(TestGrammarItem);
+	buf.insert(0, "foo bar\nfoo bar\nfoo bar");
+	buf.bump_revision();
+	buf.wait_for_repair();
+	buf.set_mark(12, "bookmark");
+	buf.add_callback(&cb);
+
+	std::multimap<std::pair<size_t, size_t>, std::string> const replacements = {
+		{ { 0, 3 }, "bar\n" }, { { 8, 11 }, "" }, { { 16, 16 }, "x" }, { { 16, 19 }, "foo" },
+	};
+	OAK_ASSERT_EQ(buf.replace(replacements), 18);
+	OAK_ASSERT_EQ(buf.substr(0, buf.size()), "bar\n bar\n bar\nxfoo bar");
+	OAK_ASSERT_EQ(buf.lines(), 4);
+	OAK_ASSERT_EQ(cb.actual.size(), 1);
+	OAK_ASSERT_EQ(cb.actual.back(), "0-19: bar\n bar\n bar\nxfoo");
+	std::map<size_t, std::string> const bookmarks = { { 10, "" } };
+	OAK_ASSERT(buf.get_marks(0, buf.size(), "bookmark") == bookmarks);
+
+	buf.bump_revision();
+	buf.wait_for_repair();
+	OAK_ASSERT_EQ(to_s(buf), "«test»«bar»bar«/bar»\n «bar»bar«/bar»\n «bar»bar«/bar»\nx«foo»foo«/foo» «bar»bar«/bar»«/test»");
+
+	buf.remove_callback(&cb);
+}
+
+void test_snapshot ()
+{
+	ng::buffer_t buf;
+	buf.insert(0, "Hello world");
+	buf.bump_revision();
+
+	ng::snapshot_ptr snapshot = buf.snapshot();
+	buf.insert(5, ",");
+	buf.insert(buf.size(), "!");
+	buf.erase(0, 1);
+
+	OAK_ASSERT_EQ(buf.substr(0, buf.size()), "ello, world!");
+	OAK_ASSERT_EQ(snapshot->substr(0, snapshot->size()), "Hello world");
+	OAK_ASSERT_EQ(snapshot->revision(), 1);
+
+	std::string text;
+	snapshot->visit_data([&text](char const* bytes, size_t offset, size_t len, bool*){
+		text.insert(offset, bytes, len);
+	});
+	OAK_ASSERT_EQ(text, "Hello world");
+}
+
+void test_snapshot_concurrent_read ()
+{
+	std::string text;
+	for(size_t i = 0; i < 10000; ++i)
+		text += text::format("%zu: foo(bar, baz) + foobar\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+
+	auto mismatches = std::make_shared<std::atomic<size_t>>(0);
+	dispatch_group_t group = dispatch_group_create();
+	for(size_t i = 0; i < 50; ++i)
+	{
+		ng::snapshot_ptr snapshot = buf.snapshot();
+		std::string const expected = buf.substr(0, buf.size());
+		dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			if(snapshot->substr(0, snapshot->size()) != expected)
+				++*mismatches;
+		});
+
+		for(size_t j = 0; j < 20; ++j)
+		{
+			size_t const pos = arc4random_uniform(buf.size());
+			buf.replace(pos, std::min(pos + 3, buf.size()), "quux");
+		}
+	}
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	OAK_ASSERT_EQ(mismatches->load(), 0);
+}
+
+void test_insert_many_lines ()
+{
+	std::string lines;
+	for(size_t i = 0; i < 1000; ++i)
+		lines += text::format("line %zu\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, "first\nlast\n");
+	buf.insert(6, lines);
+	buf.insert(buf.size(), "\n");
+
+	OAK_ASSERT_EQ(buf.lines(), 1004);
+	OAK_ASSERT_EQ(buf.substr(buf.begin(1), buf.eol(1)), "line 0");
+	OAK_ASSERT_EQ(buf.substr(buf.begin(1000), buf.eol(1000)), "line 999");
+	OAK_ASSERT_EQ(buf.substr(buf.begin(1001), buf.eol(1001)), "last");
+	OAK_ASSERT_EQ(buf.convert(buf.begin(500) + 2).line, 500);
+}
+
+static ng::memory_usage_t::entry_t find_entry (ng::memory_usage_t const& usage, std::string const& name)
+{
+	for(auto const& entry : usage.entries)
+	{
+		if(entry.name == name)
+			return entry;
+	}
+	return { name, 0, 0 };
+}
+
+void test_memory_usage ()
+{
+	std::string text;
+	for(size_t i = 0; i < 1000; ++i)
+		text += text::format("%zu: foo(bar, baz)\n", i);
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_mark(5, "bookmark");
+	buf.set_grammar(TestGrammarItem);
+	buf.wait_for_repair();
+
+	ng::memory_usage_t const usage = buf.memory_usage();
+	OAK_ASSERT_GE(find_entry(usage, "text").bytes, text.size());
+	OAK_ASSERT_EQ(find_entry(usage, "hardlines").nodes, 1000);
+	OAK_ASSERT_GE(find_entry(usage, "scopes").nodes, 2000);
+	OAK_ASSERT_EQ(find_entry(usage, "marks (bookmark)").nodes, 1);
+	OAK_ASSERT_GT(usage.bytes(), text.size());
+	OAK_ASSERT_NE(to_s(usage).find("parser states"), std::string::npos);
+
+	buf.erase(0, buf.size());
+	OAK_ASSERT_EQ(find_entry(buf.memory_usage(), "hardlines").bytes, 0);
+}
+
+void test_line_view ()
+{
+	ng::buffer_t buf;
+	buf.insert(0, "foo\nbar\n");
+	buf.insert(buf.size(), "fud", 3, std::make_shared<int>(0)); // borrowed bytes are never appended to
+	buf.insert(buf.size(), "dle");
+
+	std::string scratch;
+	OAK_ASSERT_EQ(std::string(buf.line_view(0, scratch)), "foo");
+	OAK_ASSERT_EQ(std::string(buf.line_view(1, scratch)), "bar");
+	OAK_ASSERT(scratch.empty());
+	OAK_ASSERT_EQ(std::string(buf.line_view(2, scratch)), "fuddle");
+	OAK_ASSERT_EQ(scratch, "fuddle");
+}
+
+void test_speculative_parse ()
+{
+	std::string text;
+	for(size_t i = 0; i < 40000; ++i)
+	{
+		switch(arc4random_uniform(50))
+		{
+			case 0:  text += "foo /* comment\n";    break;
+			case 1:  text += "comment */ foo\n";    break;
+			case 2:  text += "/* short */ foo\n";   break;
+			default: text += "foo bar foo bar\n";   break;
+		}
+	}
+
+	std::string expected;
+	for(size_t threshold : { SIZE_T_MAX, size_t(0) })
+	{
+		ng::buffer_t buf;
+		buf.insert(0, text);
+		buf.set_speculative_parse_threshold(threshold);
+		buf.set_grammar(TestCommentGrammarItem);
+		buf.wait_for_repair();
+
+		if(threshold == SIZE_T_MAX)
+				expected = buf.xml_substr();
+		else	OAK_ASSERT(buf.xml_substr() == expected);
+	}
+}
+
+void test_priority_range ()
+{
+	struct callback_t : ng::callback_t
+	{
+		callback_t (ng::buffer_t const& buffer) : buffer(buffer) { }
+		void did_parse (size_t from, size_t to) { parsed.emplace_back(from, to); done = done || to == buffer.size(); }
+
+		ng::buffer_t const& buffer;
+		std::vector<std::pair<size_t, size_t>> parsed;
+		bool done = false;
+	};
+
+	std::string text;
+	for(size_t i = 0; i < 20000; ++i)
+		text += i % 100 == 0 ? "/* foo\n" : i % 100 == 1 ? "foo */ foo\n" : "foo bar foo bar\n";
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_async_parsing(true);
+	buf.set_parser_budget(4096, 0.015);
+	buf.set_priority_range(buf.begin(19000), buf.begin(19050));
+
+	callback_t cb(buf);
+	buf.add_callback(&cb);
+	buf.set_grammar(TestCommentGrammarItem);
+	while(!cb.done)
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.05, false);
+	buf.remove_callback(&cb);
+
+	OAK_ASSERT_EQ(cb.parsed.front().first, buf.begin(19000));
+	OAK_ASSERT_GE(cb.parsed.front().second, buf.begin(19050));
+	OAK_ASSERT_EQ(cb.parsed[1].first, 0);
+
+	ng::buffer_t expected;
+	expected.insert(0, text);
+	expected.set_grammar(TestCommentGrammarItem);
+	expected.wait_for_repair();
+	OAK_ASSERT(buf.xml_substr() == expected.xml_substr());
+}
+
+void test_priority_range_during_speculative_parse ()
+{
+	struct callback_t : ng::callback_t
+	{
+		callback_t (ng::buffer_t const& buffer) : buffer(buffer) { }
+		void did_parse (size_t from, size_t to) { parsed.emplace_back(from, to); done = done || to == buffer.size(); }
+
+		ng::buffer_t const& buffer;
+		std::vector<std::pair<size_t, size_t>> parsed;
+		bool done = false;
+	};
+
+	// Large enough for the initial parse to be speculative and to take several windows (a 64 KB chunk per worker)
+	size_t const minimumSize = std::max<size_t>(2*1024*1024, 4 * 64*1024 * ng::parse_scheduler_t::shared().maximum_workers());
+
+	std::string text;
+	for(size_t i = 0; text.size() < minimumSize; ++i)
+		text += i % 100 == 0 ? "/* foo\n" : i % 100 == 1 ? "foo */ foo\n" : "foo bar foo bar\n";
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_async_parsing(true);
+
+	callback_t cb(buf);
+	buf.add_callback(&cb);
+	buf.set_grammar(TestCommentGrammarItem);
+
+	// Jump to the end while the first window is being parsed
+	size_t const priorityFrom = buf.begin(buf.lines() - 100), priorityTo = buf.begin(buf.lines() - 50);
+	buf.set_priority_range(priorityFrom, priorityTo);
+	while(!cb.done)
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.05, false);
+	buf.remove_callback(&cb);
+
+	auto priority = std::find_if(cb.parsed.begin(), cb.parsed.end(), [=](std::pair<size_t, size_t> const& range){ return range.first == priorityFrom; });
+	OAK_ASSERT(priority != cb.parsed.end());
+	OAK_ASSERT_GE(priority->second, priorityTo);
+	OAK_ASSERT_EQ(cb.parsed.front().first, 0);
+	OAK_ASSERT(std::all_of(cb.parsed.begin(), priority, [=](std::pair<size_t, size_t> const& range){ return range.second <= priorityFrom; }));
+
+	ng::buffer_t expected;
+	expected.insert(0, text);
+	expected.set_grammar(TestCommentGrammarItem);
+	expected.wait_for_repair();
+	OAK_ASSERT(buf.xml_substr() == expected.xml_substr());
+}
+
+void test_long_line_parse ()
+{
+	struct callback_t : ng::callback_t
+	{
+		callback_t (ng::buffer_t const& buffer) : buffer(buffer) { }
+		void did_parse (size_t from, size_t to) { done = done || to == buffer.size(); }
+
+		ng::buffer_t const& buffer;
+		bool done = false;
+	};
+
+	std::string text;
+	for(size_t i = 0; i < 20000; ++i)
+		text += "foo /* x */ ";
+	text += "foo /* open\nstill */ foo\n";
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_async_parsing(true);
+	buf.set_parser_budget(4096, 0); // each job stops after the first step of the long line
+
+	callback_t cb(buf);
+	buf.add_callback(&cb);
+	buf.set_grammar(TestCommentGrammarItem);
+	while(!cb.done)
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.05, false);
+	buf.remove_callback(&cb);
+
+	OAK_ASSERT_EQ(to_s(buf.scope(buf.begin(1)).right), "test.comment comment");
+
+	ng::buffer_t expected;
+	expected.insert(0, text);
+	expected.set_grammar(TestCommentGrammarItem);
+	expected.wait_for_repair();
+	OAK_ASSERT(buf.xml_substr() == expected.xml_substr());
+}
+
+void test_long_line_parse_with_edits ()
+{
+	struct callback_t : ng::callback_t
+	{
+		callback_t (ng::buffer_t const& buffer) : buffer(buffer) { }
+		void did_parse (size_t from, size_t to) { done = done || to == buffer.size(); }
+
+		ng::buffer_t const& buffer;
+		bool done = false;
+	};
+
+	std::string text;
+	for(size_t i = 0; i < 20000; ++i)
+		text += "foo /* x */ ";
+	text += "foo /* open\nstill */ foo\n";
+
+	ng::buffer_t buf;
+	buf.insert(0, text);
+	buf.set_async_parsing(true);
+	buf.set_parser_budget(4096, 0); // each job stops after the first step of the long line
+
+	size_t const bytesParsed = parse::statistics().bytes_parsed;
+	callback_t cb(buf);
+	buf.add_callback(&cb);
+	buf.set_grammar(TestCommentGrammarItem);
+
+	// Append to the buffer (like a log) while the long line is being parsed, this should not make the parser start the line over
+	while(to_s(buf.scope(buf.eol(0)).left) != "test.comment comment")
+	{
+		buf.insert(buf.size(), "log\n");
+		buf.bump_revision();
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.001, false);
+	}
+	while(!cb.done)
+		CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.05, false);
+	buf.remove_callback(&cb);
+
+	OAK_ASSERT_LT(parse::statistics().bytes_parsed - bytesParsed, buf.size() + 64*1024);
+
+	ng::buffer_t expected;
+	expected.insert(0, buf.substr(0, buf.size()));
+	expected.set_grammar(TestCommentGrammarItem);
+	expected.wait_for_repair();
+	OAK_ASSERT(buf.xml_substr() == expected.xml_substr());
+}
+
+void test_compact ()
+{
+	ng::buffer_t buf;
+	buf.insert(0, std::string(100000, ' '));
+	for(size_t i = 0; i < 1000; ++i)
+		buf.replace(i * 97, i * 97 + 3, "foo");
+
+	OAK_ASSERT_GT(buf.fragmentation().chunks, 1000);
+	std::string const text = buf.substr(0, buf.size());
+	buf.compact();
+	OAK_ASSERT_LT(buf.fragmentation().chunks, 10);
+	OAK_ASSERT_EQ(buf.substr(0, buf.size()), text);
+}
+
 void test_markup ()
 {
 	ng::buffer_t buf;
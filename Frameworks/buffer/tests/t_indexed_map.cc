@@ -1,4 +1,6 @@
 #include <buffer/indexed_map.h>
+#include <buffer/indexed_btree.h>
+#include <oak/duration.h>
 #include <oak/oak.h>
 
 static ssize_t const TestKeys[5][3] =
@@ -369,3 +371,163 @@ void test_bind_left_right ()
 		}
 	}
 }
+
+void test_set_range ()
+{
+	for(size_t round = 0; round < 200; ++round)
+	{
+		indexed_map_t<size_t> map;
+		std::map<ssize_t, size_t> reference;
+		for(size_t i = arc4random_uniform(100); i > 0; --i)
+		{
+			ssize_t const pos = ssize_t(arc4random_uniform(1000)) - 1;
+			map.set(pos, i);
+			reference[pos] = i;
+		}
+
+		ssize_t const from = arc4random_uniform(1000);
+		ssize_t const to   = from + arc4random_uniform(200);
+
+		std::vector<std::pair<ssize_t, size_t>> entries;
+		for(ssize_t pos = from; pos < to; pos += 1 + arc4random_uniform(round % 2 ? 3 : 50))
+			entries.emplace_back(pos, pos);
+
+		map.set_range(from, to, entries);
+		reference.erase(reference.lower_bound(from), reference.lower_bound(to));
+		reference.insert(entries.begin(), entries.end());
+
+		std::vector< std::pair<ssize_t, size_t> > const sorted(reference.begin(), reference.end());
+		OAK_ASSERT(values(map) == sorted);
+		OAK_ASSERT_EQ(map.size(), reference.size());
+		for(size_t n = 0; n < reference.size(); ++n)
+			OAK_ASSERT_EQ(map.nth(n)->first, std::next(reference.begin(), n)->first);
+	}
+}
+
+template <typename T>
+std::vector< std::pair<ssize_t, size_t> > reversed_values (T const& map)
+{
+	std::vector< std::pair<ssize_t, size_t> > res;
+	for(auto it = map.end(); it != map.begin(); )
+		res.push_back(*--it);
+	std::reverse(res.begin(), res.end());
+	return res;
+}
+
+void test_btree ()
+{
+	for(size_t round = 0; round < 20; ++round)
+	{
+		indexed_map_t<size_t> map;
+		indexed_btree_t<size_t> btree;
+
+		for(size_t i = 0; i < 2000; ++i)
+		{
+			ssize_t const from = ssize_t(arc4random_uniform(20000)) - 1;
+			ssize_t const to   = from + arc4random_uniform(100);
+			switch(arc4random_uniform(round % 2 ? 4 : 8))
+			{
+				case 0:
+				case 1:
+				case 4:
+				case 5:
+				case 6:
+				{
+					map.set(from, i);
+					btree.set(from, i);
+				}
+				break;
+
+				case 2:
+				case 7:
+				{
+					auto const pos = map.nth(arc4random_uniform(map.size() + 1));
+					if(pos != map.end())
+					{
+						map.remove(pos->first);
+						btree.remove(pos->first);
+					}
+				}
+				break;
+
+				case 3:
+				{
+					size_t const len = arc4random_uniform(100);
+					bool const bindRight = arc4random_uniform(2);
+					map.replace(from, to, len, bindRight);
+					btree.replace(from, to, len, bindRight);
+				}
+				break;
+			}
+		}
+
+		std::vector<std::pair<ssize_t, size_t>> entries;
+		for(ssize_t pos = 5000; pos < 6000; pos += 1 + arc4random_uniform(4))
+			entries.emplace_back(pos, pos);
+		map.set_range(5000, 6000, entries);
+		btree.set_range(5000, 6000, entries);
+
+		OAK_ASSERT_EQ(btree.size(), map.size());
+		OAK_ASSERT(values(btree) == values(map));
+		OAK_ASSERT(reversed_values(btree) == values(map));
+
+		for(size_t n = 0; n <= map.size(); ++n)
+		{
+			OAK_ASSERT_EQ(btree.nth(n).index(), n);
+			OAK_ASSERT(n == map.size() ? btree.nth(n) == btree.end() : btree.nth(n)->first == map.nth(n)->first);
+		}
+
+		for(ssize_t key = -2; key < 21000; key += 7)
+		{
+			OAK_ASSERT_EQ(btree.lower_bound(key).index(), map.lower_bound(key).index());
+			OAK_ASSERT_EQ(btree.upper_bound(key).index(), map.upper_bound(key).index());
+			OAK_ASSERT_EQ(btree.find(key).index(), map.find(key).index());
+		}
+
+		indexed_btree_t<size_t> copy = btree;
+		OAK_ASSERT(values(copy) == values(map));
+
+		auto const keys = values(map);
+		for(auto const& pair : keys)
+			btree.remove(pair.first);
+		OAK_ASSERT(btree.empty());
+		OAK_ASSERT(btree.begin() == btree.end());
+	}
+}
+
+template <typename T>
+static void benchmark_line_conversion (char const* name, std::vector<std::pair<ssize_t, bool>> const& newlines, std::vector<size_t> const& offsets)
+{
+	T map;
+	oak::duration_t timer;
+	map.set_range(0, SSIZE_MAX, newlines);
+	double const buildTime = timer.duration();
+
+	size_t sum = 0;
+	timer.reset();
+	for(size_t offset : offsets)
+		sum += map.lower_bound(offset).index();
+	double const lineTime = timer.duration();
+
+	timer.reset();
+	for(size_t offset : offsets)
+		sum += map.nth(offset % newlines.size())->first;
+	double const offsetTime = timer.duration();
+
+	fprintf(stdout, "%s: %zu lines, %zu nodes, height %zu: build %.0f ms, %zu offset → line %.0f ms, %zu line → offset %.0f ms (checksum %zu)\n", name, newlines.size(), map.number_of_nodes(), map.height(), buildTime * 1000, offsets.size(), lineTime * 1000, offsets.size(), offsetTime * 1000, sum);
+}
+
+void benchmark_line_conversion_10m_lines ()
+{
+	std::vector<std::pair<ssize_t, bool>> newlines;
+	newlines.reserve(10000000);
+	for(ssize_t pos = arc4random_uniform(80); newlines.size() < 10000000; pos += 1 + arc4random_uniform(80))
+		newlines.emplace_back(pos, true);
+
+	std::vector<size_t> offsets;
+	for(size_t i = 0; i < 1000000; ++i)
+		offsets.push_back(arc4random_uniform(newlines.back().first));
+
+	benchmark_line_conversion<indexed_map_t<bool>>("AA-tree", newlines, offsets);
+	benchmark_line_conversion<indexed_btree_t<bool>>("B+-tree", newlines, offsets);
+}
@@ -0,0 +1,70 @@
+#include <buffer/parse_scheduler.h>
+#include <atomic>
+
+static void run_jobs (ng::parse_scheduler_t& scheduler, size_t count, bool foreground, std::atomic<size_t>& maximumRunning)
+{
+	auto owner = std::make_shared<bool>(true);
+	std::atomic<size_t>* maximum = &maximumRunning;
+	auto running = std::make_shared<std::atomic<size_t>>(0);
+
+	dispatch_group_t group = dispatch_group_create();
+	for(size_t i = 0; i < count; ++i)
+	{
+		dispatch_group_enter(group);
+		scheduler.submit(owner, foreground, [=](){
+			size_t n = ++*running;
+			for(size_t old = *maximum; old < n && !maximum->compare_exchange_weak(old, n); )
+				continue;
+			usleep(1000);
+			--*running;
+			dispatch_group_leave(group);
+		});
+	}
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+	while(scheduler.statistics().running) // the last job has left the group but may not have returned yet
+		usleep(1000);
+}
+
+void test_worker_limits ()
+{
+	ng::parse_scheduler_t scheduler(3, 1);
+
+	std::atomic<size_t> foreground(0), background(0);
+	run_jobs(scheduler, 30, true, foreground);
+	run_jobs(scheduler, 30, false, background);
+
+	OAK_ASSERT_LE(foreground.load(), 3);
+	OAK_ASSERT_EQ(background.load(), 1);
+	OAK_ASSERT_EQ(scheduler.statistics().completed, 60);
+	OAK_ASSERT_EQ(scheduler.statistics().queued, 0);
+	OAK_ASSERT_EQ(scheduler.statistics().running, 0);
+}
+
+void test_priority_and_cancellation ()
+{
+	ng::parse_scheduler_t scheduler(1, 1);
+	auto owner = std::make_shared<bool>(true);
+	auto closed = std::make_shared<bool>(true);
+
+	std::mutex mutex;
+	std::vector<std::string> order;
+	dispatch_semaphore_t blocked = dispatch_semaphore_create(0);
+	dispatch_semaphore_t done    = dispatch_semaphore_create(0);
+
+	scheduler.submit(owner, true, [=](){ dispatch_semaphore_wait(blocked, DISPATCH_TIME_FOREVER); });
+	scheduler.submit(owner, false, [&](){ std::lock_guard<std::mutex> lock(mutex); order.push_back("background"); });
+	scheduler.submit(closed, true, [&](){ std::lock_guard<std::mutex> lock(mutex); order.push_back("closed"); });
+	scheduler.submit(owner, true, [&](){ std::lock_guard<std::mutex> lock(mutex); order.push_back("foreground"); });
+	scheduler.submit(owner, false, [=](){ dispatch_semaphore_signal(done); });
+
+	closed.reset();
+	dispatch_semaphore_signal(blocked);
+	dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	OAK_ASSERT_EQ(order.size(), 2);
+	OAK_ASSERT_EQ(order[0], "foreground");
+	OAK_ASSERT_EQ(order[1], "background");
+	OAK_ASSERT_EQ(scheduler.statistics().cancelled, 1);
+}
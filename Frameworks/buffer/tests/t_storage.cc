@@ -200,3 +200,90 @@ void test_random_substr_access ()
 	for(auto range : random_ranges(storage.size()))
 		OAK_ASSERT_EQ(storage.substr(range.src, range.src + range.len), buffer.substr(range.src, range.len));
 }
+
+void test_view ()
+{
+	std::string const buffer = create_buffer();
+	ng::detail::storage_t storage;
+	storage.insert(0, buffer.data(), buffer.size() / 2);
+	storage.insert(storage.size(), buffer.data() + buffer.size() / 2, buffer.size() - buffer.size() / 2);
+
+	std::string scratch;
+	for(auto range : random_ranges(storage.size()))
+		OAK_ASSERT_EQ(std::string(storage.view(range.src, range.src + range.len, scratch)), buffer.substr(range.src, range.len));
+
+	scratch = "";
+	std::shared_ptr<void const> owner;
+	std::string_view const view = storage.view(10, 20, scratch, &owner);
+	OAK_ASSERT(owner);
+	OAK_ASSERT(scratch.empty());
+	OAK_ASSERT_EQ(std::string(view), buffer.substr(10, 10));
+
+	storage.clear();
+	OAK_ASSERT_EQ(std::string(view), buffer.substr(10, 10)); // still alive thanks to owner
+}
+
+void test_borrowed_memory ()
+{
+	auto const buffer = std::make_shared<std::string>(create_buffer());
+	ng::detail::storage_t storage;
+	storage.insert(0, buffer->data(), buffer->size(), buffer);
+	OAK_ASSERT_EQ(buffer.use_count(), 2);
+	OAK_ASSERT_EQ((*storage.begin()).data(), buffer->data());
+
+	std::string expected = *buffer;
+	for(size_t i = 0; i < 100; ++i)
+	{
+		size_t const pos = arc4random_uniform(storage.size());
+		storage.insert(pos, "x", 1);
+		expected.insert(pos, "x");
+
+		size_t const len = std::min<size_t>(arc4random_uniform(50), storage.size() - pos);
+		storage.erase(pos, pos + len);
+		expected.erase(pos, len);
+	}
+	OAK_ASSERT_EQ(storage.substr(0, storage.size()), expected);
+
+	storage.clear();
+	OAK_ASSERT_EQ(buffer.use_count(), 1);
+}
+
+void test_compaction ()
+{
+	auto const mapped = std::make_shared<std::string>(create_buffer(10000));
+	ng::detail::storage_t storage;
+	std::string const text = create_buffer(200 * 1024);
+	storage.insert(0, text.data(), text.size());
+	storage.insert(1000, mapped->data(), mapped->size(), mapped);
+
+	std::string expected = storage.substr(0, storage.size());
+	for(size_t i = 0; i < 2000; ++i)
+	{
+		size_t const pos = arc4random_uniform(storage.size());
+		std::string const str(1 + arc4random_uniform(20), 'a' + (i % 26));
+		storage.insert(pos, str.data(), str.size());
+		expected.insert(pos, str);
+
+		size_t const len = std::min<size_t>(arc4random_uniform(20), storage.size() - pos);
+		storage.erase(pos, pos + len);
+		expected.erase(pos, len);
+	}
+
+	auto const before = storage.fragmentation();
+	OAK_ASSERT_EQ(before.chunks, storage.chunks());
+	OAK_ASSERT_GT(before.small_chunks, 1000);
+
+	size_t slices = 0;
+	for(size_t pos = 0; pos < storage.size(); ++slices)
+		pos = storage.compact(pos, 16 * 1024);
+	OAK_ASSERT_GT(slices, 1);
+	OAK_ASSERT_EQ(storage.substr(0, storage.size()), expected);
+
+	auto const after = storage.fragmentation();
+	OAK_ASSERT_LT(after.chunks, before.chunks);
+	OAK_ASSERT_LT(after.chunks, 20);
+	OAK_ASSERT_LT(after.wasted, before.wasted);
+
+	storage.clear();
+	OAK_ASSERT_EQ(mapped.use_count(), 1);
+}
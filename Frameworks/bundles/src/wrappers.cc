@@ -187,6 +187,20 @@ namespace bundles
 
 	plist::any_t value_for_setting (std::string const& setting, scope::context_t const& scope, item_ptr* match)
 	{
+		// Keyed on the interned scopes so a lookup is a few pointer compares rather than converting the scope to a string
+		struct key_t
+		{
+			std::string setting;
+			scope::scope_t left, right;
+
+			bool operator== (key_t const& rhs) const { return left == rhs.left && right == rhs.right && setting == rhs.setting; }
+		};
+
+		struct key_hash_t
+		{
+			size_t operator() (key_t const& key) const { return std::hash<std::string>()(key.setting) ^ key.left.hash() ^ (key.right.hash() << 1); }
+		};
+
 		struct cache_t : bundles::callback_t
 		{
 			cache_t ()
@@ -200,22 +214,22 @@ namespace bundles
 				map.clear();
 			}
 
-			std::map<std::string, item_ptr> map;
+			std::unordered_map<key_t, item_ptr, key_hash_t> map;
 			std::mutex mutex;
 		};
 
 		static cache_t cache;
 		std::lock_guard<std::mutex> lock(cache.mutex);
 
-		std::string const key = setting + "\037" + to_s(scope);
+		key_t key = { setting, scope.left, scope.right };
 		auto iter = cache.map.find(key);
 		if(iter == cache.map.end())
 		{
-			if(cache.map.size() > 1000)
+			if(cache.map.size() > 10000)
 				cache.map.clear();
 
 			auto items = query(kFieldSettingName, setting, scope, kItemTypeSettings);
-			iter = cache.map.emplace(key, items.empty() ? item_ptr() : items.front()).first;
+			iter = cache.map.emplace(std::move(key), items.empty() ? item_ptr() : items.front()).first;
 		}
 
 		plist::any_t res;
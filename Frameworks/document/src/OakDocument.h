@@ -98,6 +98,7 @@ typedef NS_ENUM(NSInteger, OakDocumentIOResult) {
 - (void)enumerateSymbolsUsingBlock:(void(^)(text::pos_t const& pos, NSString* symbol))block;
 - (void)enumerateBookmarksUsingBlock:(void(^)(text::pos_t const& pos, NSString* excerpt))block;
 - (void)enumerateBookmarksAtLine:(NSUInteger)line block:(void(^)(text::pos_t const& pos, NSString* type, NSString* payload))block;
+// The block is called synchronously on the caller’s thread, which need not be the main thread. For a loaded document it reads a snapshot taken on the main thread before the first call (copying the buffer’s chunk tree, so the cost grows with the number of chunks, not the size of the text), so it sees the text as it was then, even if the document is edited meanwhile. The block must not touch AppKit or other main-thread-only state.
 - (void)enumerateByteRangesUsingBlock:(void(^)(char const* bytes, NSRange byteRange, BOOL* stop))block;
 - (NSArray<OakDocumentMatch*>*)matchesForString:(NSString*)searchString options:(find::options_t)options;
 - (NSArray<OakDocumentMatch*>*)matchesForString:(NSString*)searchString options:(find::options_t)options bufferSize:(NSUInteger*)bufferSize;
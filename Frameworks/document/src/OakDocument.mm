@@ -4,6 +4,7 @@
 #import "EncodingView.h"
 #import "Printing.h"
 #import "merge.h"
+#import "match_context.h"
 #import <FileBrowser/FileItemImage.h>
 #import <FileBrowser/KEventManager.h>
 #import <OakFoundation/OakFoundation.h>
@@ -790,7 +791,7 @@ NSString* OakDocumentBookmarkIdentifier                          = @"bookmark";
 	}
 
 	[self createBuffer];
-	_buffer->insert(0, content->get(), content->size());
+	_buffer->insert(0, content->get(), content->size(), content);
 
 	if(_path)
 		document::marks.move_to_buffer(to_s(_path), *_buffer);
@@ -1257,18 +1258,22 @@ NSString* OakDocumentBookmarkIdentifier                          = @"bookmark";
 {
 	if(_buffer || (_backupPath && !self.isLoaded))
 	{
+		// Only taking the snapshot requires the main thread, so background searches do not block the user while they read the text
+		__block ng::snapshot_ptr snapshot;
 		auto handler = ^{
 			[self tryLoadBackup];
-			_buffer->visit_data([block](char const* bytes, size_t offset, size_t len, bool* tmp){
-				BOOL stop = NO;
-				block(bytes, NSMakeRange(offset, len), &stop);
-				*tmp = stop;
-			});
+			snapshot = _buffer->snapshot();
 		};
 
 		if([NSThread isMainThread])
 				handler();
 		else	dispatch_sync(dispatch_get_main_queue(), handler);
+
+		snapshot->visit_data([block](char const* bytes, size_t offset, size_t len, bool* tmp){
+			BOOL stop = NO;
+			block(bytes, NSMakeRange(offset, len), &stop);
+			*tmp = stop;
+		});
 	}
 	else if(_path)
 	{
@@ -1324,8 +1329,9 @@ NSString* OakDocumentBookmarkIdentifier                          = @"bookmark";
 {
 	NSMutableArray<OakDocumentMatch*>* results = [NSMutableArray array];
 
-	__block find::find_t f(to_s(searchString), options | (self.isLoaded == NO && (options & find::regular_expression) ? find::filesize_limit : find::none));
+	__block find::find_t f(to_s(searchString), options | (self.isLoaded == NO && (options & find::regular_expression) ? find::windowed : find::none));
 	__block boost::crc_32_type crc32;
+	__block text::line_endings_estimator_t newlines;
 	__block size_t total = 0;
 
 	[self enumerateByteRangesUsingBlock:^(char const* bytes, NSRange byteRange, BOOL* stop){
@@ -1344,6 +1350,7 @@ NSString* OakDocumentBookmarkIdentifier                          = @"bookmark";
 		});
 
 		crc32.process_bytes(bytes, byteRange.length);
+		newlines.add(bytes, bytes + byteRange.length);
 		total = NSMaxRange(byteRange);
 	}];
 
@@ -1361,63 +1368,37 @@ NSString* OakDocumentBookmarkIdentifier                          = @"bookmark";
 	if(results.count == 0)
 		return nil;
 
-	__block std::string text;
+	// Read the text again to find line numbers and excerpts, this way we never hold more than a few hundred bytes of it per match
+	std::vector<std::pair<size_t, size_t>> ranges;
+	for(OakDocumentMatch* match in results)
+		ranges.emplace_back(match.first, match.last);
+
+	std::string const crlf = newlines.result();
+	__block match_context_t context(ranges, crlf);
+	__block boost::crc_32_type doubleCheck;
 	[self enumerateByteRangesUsingBlock:^(char const* bytes, NSRange byteRange, BOOL* stop){
-		text.insert(text.end(), bytes, bytes + byteRange.length);
+		context.add(bytes, byteRange.length);
+		doubleCheck.process_bytes(bytes, byteRange.length);
 	}];
 
 	// Document has changed, should probably re-scan
-	boost::crc_32_type doubleCheck;
-	doubleCheck.process_bytes(text.data(), text.size());
 	if(crc32.checksum() != doubleCheck.checksum())
 		return nil;
 
-	std::string const crlf = text::estimate_line_endings(std::begin(text), std::end(text));
-
-	size_t bol = 0, crlfCount = 0;
-	size_t eol = text.find(crlf, bol);
-
-	for(OakDocumentMatch* match in results)
+	auto const& contexts = context.finish();
+	for(NSUInteger i = 0; i < results.count; ++i)
 	{
-		while(eol != std::string::npos && eol + crlf.size() <= match.first)
-		{
-			bol = eol + crlf.size();
-			eol = text.find(crlf, bol);
-			++crlfCount;
-		}
-
-		text::pos_t from(crlfCount, match.first - bol);
-		size_t fromOffset = bol;
-
-		while(eol != std::string::npos && eol + crlf.size() <= match.last)
-		{
-			bol = eol + crlf.size();
-			eol = text.find(crlf, bol);
-			++crlfCount;
-		}
-
-		text::pos_t to(crlfCount, match.last - bol);
-		size_t toOffset = (bol == match.last && match.first != match.last) ? bol : (eol != std::string::npos ? (match.last <= eol ? eol : eol + crlf.size()) : text.size());
-
-		size_t orgFromOffset = fromOffset;
-		if(match.first - fromOffset > 200)
-			fromOffset = utf8::find_safe_end(text.begin(), text.begin() + match.first - ((match.first - fromOffset) % 150)) - text.begin();
-
-		size_t orgToOffset = toOffset;
-		if(toOffset - fromOffset > 500)
-			toOffset = utf8::find_safe_end(text.begin(), text.begin() + std::max<size_t>(fromOffset + 500, match.last)) - text.begin();
-
-		ASSERT_LE(fromOffset, match.first);
-		ASSERT_LE(match.last, toOffset);
+		OakDocumentMatch* match = results[i];
+		match_context_t::match_t const& info = contexts[i];
 
 		match.document      = self;
 		match.checksum      = crc32.checksum();
-		match.range         = text::range_t(from, to);
-		match.excerpt       = to_ns(text.substr(fromOffset, toOffset - fromOffset));
-		match.excerptOffset = fromOffset;
+		match.range         = text::range_t(info.from, info.to);
+		match.excerpt       = to_ns(info.excerpt);
+		match.excerptOffset = info.excerpt_offset;
 		match.newlines      = to_ns(crlf);
-		match.headTruncated = orgFromOffset < fromOffset;
-		match.tailTruncated = toOffset < orgToOffset;
+		match.headTruncated = info.head_truncated;
+		match.tailTruncated = info.tail_truncated;
 	}
 
 	return results;
@@ -0,0 +1,163 @@
+#include "match_context.h"
+#include <text/utf8.h>
+
+static size_t const kExcerptHeadBytes = 200; // when a match starts further into its line the excerpt starts (at a multiple of kExcerptHeadStride) before the match
+static size_t const kExcerptHeadStride = 150;
+static size_t const kExcerptBytes = 500;
+static size_t const kTailBytes = 256; // must be enough for kExcerptHeadBytes and looking back for a safe UTF-8 boundary
+
+match_context_t::match_context_t (std::vector<std::pair<size_t, size_t>> const& ranges, std::string const& newlines) : _newlines(newlines)
+{
+	_matches.reserve(ranges.size());
+	for(auto const& range : ranges)
+	{
+		match_t match;
+		match.first = range.first;
+		match.last  = range.second;
+		_matches.push_back(match);
+	}
+}
+
+size_t match_context_t::next_event () const
+{
+	size_t res = SIZE_T_MAX;
+	if(_next_first < _matches.size())
+		res = std::min(res, _matches[_next_first].first);
+	if(_next_last < _matches.size())
+		res = std::min(res, _matches[_next_last].last);
+	for(auto const& capture : _captures)
+	{
+		if(capture.reached_last)
+			res = std::min(res, capture.capture_end + _newlines.size());
+	}
+	return res;
+}
+
+void match_context_t::complete (capture_t const& capture, size_t toOffset, bool knownToOffset)
+{
+	match_t& match = _matches[capture.index];
+
+	size_t to = toOffset;
+	if(!knownToOffset || to - match.excerpt_offset > kExcerptBytes)
+		to = utf8::find_safe_end(match.excerpt.begin(), match.excerpt.begin() + std::min(capture.capture_end - match.excerpt_offset, match.excerpt.size())) - match.excerpt.begin() + match.excerpt_offset;
+
+	match.excerpt.resize(std::min(to - match.excerpt_offset, match.excerpt.size()));
+	match.tail_truncated = !knownToOffset || to < toOffset;
+}
+
+// Called before the byte at offset, when all line endings before it have been counted
+void match_context_t::reached (size_t offset)
+{
+	for(; _next_first < _matches.size() && _matches[_next_first].first == offset; ++_next_first)
+	{
+		match_t& match = _matches[_next_first];
+		match.from = text::pos_t(_lines, match.first - _bol);
+
+		size_t const tailStart = offset - _tail.size();
+		size_t fromOffset = _bol;
+		if(match.first - fromOffset > kExcerptHeadBytes)
+			fromOffset = utf8::find_safe_end(_tail.begin(), _tail.begin() + (match.first - ((match.first - fromOffset) % kExcerptHeadStride) - tailStart)) - _tail.begin() + tailStart;
+
+		match.excerpt        = _tail.substr(fromOffset - tailStart);
+		match.excerpt_offset = fromOffset;
+		match.head_truncated = _bol < fromOffset;
+		_captures.push_back({ _next_first, std::max(fromOffset + kExcerptBytes, match.last) });
+	}
+
+	for(; _next_last < _next_first && _matches[_next_last].last == offset; ++_next_last)
+	{
+		match_t& match = _matches[_next_last];
+		match.to = text::pos_t(_lines, match.last - _bol);
+
+		auto capture = std::find_if(_captures.begin(), _captures.end(), [&](capture_t const& capture){ return capture.index == _next_last; });
+		capture->reached_last = true;
+		if(_bol == match.last && match.first != match.last) // the match ends with a line ending so the excerpt ends here
+		{
+			complete(*capture, _bol, true);
+			_captures.erase(capture);
+		}
+	}
+
+	// Not having seen the end of the line by now means the excerpt is truncated
+	for(auto capture = _captures.begin(); capture != _captures.end(); )
+	{
+		if(capture->reached_last && capture->capture_end + _newlines.size() <= offset)
+		{
+			complete(*capture, SIZE_T_MAX, false);
+			capture = _captures.erase(capture);
+		}
+		else
+		{
+			++capture;
+		}
+	}
+}
+
+// Called with the position of a line ending when we have seen all of it
+void match_context_t::did_find_newline (size_t eol)
+{
+	for(auto capture = _captures.begin(); capture != _captures.end(); )
+	{
+		if(capture->reached_last)
+		{
+			size_t const last = _matches[capture->index].last;
+			complete(*capture, last <= eol ? eol : eol + _newlines.size(), true);
+			capture = _captures.erase(capture);
+		}
+		else
+		{
+			++capture;
+		}
+	}
+
+	++_lines;
+	_bol = eol + _newlines.size();
+}
+
+void match_context_t::add (char const* bytes, size_t len)
+{
+	char const* const end = bytes + len;
+	while(bytes != end)
+	{
+		reached(_offset);
+		size_t const n = std::min<size_t>(end - bytes, next_event() - _offset);
+
+		for(auto const& capture : _captures)
+		{
+			if(_offset < capture.capture_end)
+				_matches[capture.index].excerpt.append(bytes, std::min(n, capture.capture_end - _offset));
+		}
+
+		char const newline = _newlines.back();
+		for(char const* it = bytes; (it = (char const*)memchr(it, newline, bytes + n - it)); ++it)
+		{
+			char const previous = it == bytes ? _previous : it[-1];
+			if(_newlines.size() == 1 || previous == _newlines.front())
+				did_find_newline(_offset + (it - bytes) + 1 - _newlines.size());
+		}
+
+		if(n < kTailBytes)
+		{
+			_tail.append(bytes, n);
+			if(_tail.size() > kTailBytes)
+				_tail.erase(0, _tail.size() - kTailBytes);
+		}
+		else
+		{
+			_tail.assign(bytes + n - kTailBytes, kTailBytes);
+		}
+
+		_previous = bytes[n-1];
+		_offset  += n;
+		bytes    += n;
+	}
+}
+
+std::vector<match_context_t::match_t> const& match_context_t::finish ()
+{
+	reached(_offset);
+	for(auto const& capture : _captures)
+		complete(capture, _offset, true); // no line ending after the match so the excerpt ends with the text
+	_captures.clear();
+	return _matches;
+}
@@ -0,0 +1,47 @@
+#ifndef MATCH_CONTEXT_H_R4K8WQ2M
+#define MATCH_CONTEXT_H_R4K8WQ2M
+
+#include <text/types.h>
+
+// Finds the line and column of matches and an excerpt of the lines containing each, from text given in pieces (with add) so that it never has to be in memory at once. Only the last few hundred bytes, and the excerpts of matches we have not yet seen the end of, are kept. Matches must be sorted and not overlap.
+struct match_context_t
+{
+	struct match_t
+	{
+		size_t first, last;
+		text::pos_t from, to;
+		std::string excerpt;
+		size_t excerpt_offset = 0;
+		bool head_truncated = false;
+		bool tail_truncated = false;
+	};
+
+	match_context_t (std::vector<std::pair<size_t, size_t>> const& ranges, std::string const& newlines);
+
+	void add (char const* bytes, size_t len);
+	std::vector<match_t> const& finish ();
+
+private:
+	struct capture_t
+	{
+		size_t index;             // in _matches
+		size_t capture_end;       // excerpt is never longer than this
+		bool reached_last = false;
+	};
+
+	void reached (size_t offset);
+	void did_find_newline (size_t eol);
+	void complete (capture_t const& capture, size_t toOffset, bool knownToOffset);
+	size_t next_event () const;
+
+	std::string _newlines;
+	std::vector<match_t> _matches;
+	std::vector<capture_t> _captures;
+	size_t _next_first = 0, _next_last = 0;
+
+	size_t _offset = 0, _lines = 0, _bol = 0;
+	char _previous = 0;
+	std::string _tail;
+};
+
+#endif /* end of include guard: MATCH_CONTEXT_H_R4K8WQ2M */
@@ -0,0 +1,59 @@
+#include "../src/match_context.h"
+
+static std::vector<match_context_t::match_t> contexts (std::string const& text, std::vector<std::pair<size_t, size_t>> const& ranges, std::string const& newlines, size_t pieceSize)
+{
+	match_context_t context(ranges, newlines);
+	for(size_t i = 0; i < text.size(); i += pieceSize)
+		context.add(text.data() + i, std::min(pieceSize, text.size() - i));
+	return context.finish();
+}
+
+void test_match_context ()
+{
+	std::string const text = "foo bar\nbaz foo\nfoo";
+	for(size_t pieceSize : { 1, 2, 3, 100 })
+	{
+		auto const res = contexts(text, { { 0, 3 }, { 12, 15 }, { 16, 19 } }, "\n", pieceSize);
+		OAK_ASSERT_EQ(res.size(), 3);
+
+		OAK_ASSERT_EQ(res[0].from.line, 0); OAK_ASSERT_EQ(res[0].from.column, 0);
+		OAK_ASSERT_EQ(res[0].to.line, 0);   OAK_ASSERT_EQ(res[0].to.column, 3);
+		OAK_ASSERT_EQ(res[0].excerpt, "foo bar");
+		OAK_ASSERT_EQ(res[0].excerpt_offset, 0);
+
+		OAK_ASSERT_EQ(res[1].from.line, 1); OAK_ASSERT_EQ(res[1].from.column, 4);
+		OAK_ASSERT_EQ(res[1].excerpt, "baz foo");
+		OAK_ASSERT_EQ(res[1].excerpt_offset, 8);
+
+		OAK_ASSERT_EQ(res[2].from.line, 2); OAK_ASSERT_EQ(res[2].from.column, 0);
+		OAK_ASSERT_EQ(res[2].excerpt, "foo");
+		OAK_ASSERT(!res[2].head_truncated && !res[2].tail_truncated);
+	}
+}
+
+void test_match_context_multiline ()
+{
+	std::string const text = "a\r\nfoo\r\nbar\r\nb";
+	for(size_t pieceSize : { 1, 4, 100 })
+	{
+		auto const res = contexts(text, { { 3, 11 } }, "\r\n", pieceSize);
+		OAK_ASSERT_EQ(res[0].from.line, 1); OAK_ASSERT_EQ(res[0].from.column, 0);
+		OAK_ASSERT_EQ(res[0].to.line, 2);   OAK_ASSERT_EQ(res[0].to.column, 3);
+		OAK_ASSERT_EQ(res[0].excerpt, "foo\r\nbar");
+	}
+}
+
+void test_match_context_long_line ()
+{
+	std::string const text = std::string(1000, 'x') + "foo" + std::string(1000, 'y') + "\n";
+	for(size_t pieceSize : { 7, 64*1024 })
+	{
+		auto const res = contexts(text, { { 1000, 1003 } }, "\n", pieceSize);
+		OAK_ASSERT_EQ(res[0].from.column, 1000);
+		OAK_ASSERT(res[0].head_truncated);
+		OAK_ASSERT(res[0].tail_truncated);
+		OAK_ASSERT_EQ(res[0].excerpt_offset, 1000 - (1000 % 150));
+		OAK_ASSERT_EQ(res[0].excerpt.size(), 500);
+		OAK_ASSERT_EQ(res[0].excerpt.substr(1000 % 150, 3), "foo");
+	}
+}
@@ -206,9 +206,47 @@ namespace ng
 		return replacements;
 	}
 
+	// Without snippets the ranges can be handed to the buffer as one edit, which avoids a storage update and change notification per range (Replace All, multiple carets)
+	static bool batch_replace (ng::buffer_t& buffer, std::multimap<range_t, std::string> const& replacements, ranges_t& out)
+	{
+		ranges_t res;
+		std::multimap<std::pair<size_t, size_t>, std::string> batch;
+
+		size_t last = 0;
+		ssize_t adjustment = 0;
+		for(auto const& pair : replacements)
+		{
+			range_t orgRange = pair.first.sorted();
+			if(orgRange.first.index < last)
+				return false;
+			last = orgRange.last.index;
+
+			if(orgRange.first.index == orgRange.last.index && pair.second.empty())
+			{
+				res.push_back(orgRange + adjustment);
+				continue;
+			}
+
+			std::string const pad = orgRange.freehanded && orgRange.first.carry ? std::string(orgRange.first.carry, ' ') : "";
+			size_t const from = orgRange.first.index, to = orgRange.last.index;
+			batch.emplace(std::make_pair(from, to), pad + pair.second);
+
+			size_t const caret = from + adjustment + pad.size() + pair.second.size();
+			res.push_back(range_t(from + adjustment + pad.size(), caret, false, orgRange.freehanded, true));
+			res.last().color = orgRange.color;
+			adjustment += pad.size() + pair.second.size() - (to - from);
+		}
+
+		buffer.replace(batch);
+		out = res;
+		return true;
+	}
+
 	static ranges_t replace_helper (ng::buffer_t& buffer, snippet_controller_t& snippets, std::multimap<range_t, std::string> const& replacements)
 	{
 		ranges_t res;
+		if(snippets.empty() && replacements.size() > 1 && batch_replace(buffer, replacements, res))
+			return res;
 
 		ssize_t adjustment = 0;
 		for(auto const& p1 : replacements)
@@ -559,9 +597,9 @@ namespace ng
 					auto const patterns = indent::patterns_for_scope(buffer.scope(index));
 					for(auto const& it : v)
 					{
-						if(fsm.is_ignored(std::string(it.first, it.second), patterns))
+						if(fsm.is_ignored(std::string_view(it.first, it.second - it.first), patterns))
 							continue;
-						size_t indent = fsm.scan_line(std::string(it.first, it.second), patterns);
+						size_t indent = fsm.scan_line(std::string_view(it.first, it.second - it.first), patterns);
 						int oldIndent = indent::leading_whitespace(it.first, it.second, tabSize);
 						transform::shift shifter(std::max(((int)indent)-oldIndent, -minIndent), buffer.indent());
 						str = shifter(str);
@@ -617,6 +655,7 @@ namespace ng
 
 			_buffer.remove_callback(this);
 
+			std::string scratch;
 			std::multimap<range_t, std::string> replacements;
 			for(auto const& pair : _lines)
 			{
@@ -624,7 +663,7 @@ namespace ng
 				size_t bol = _buffer.begin(n);
 				size_t eos = bol;
 
-				std::string const line = _buffer.substr(bol, _buffer.eol(n));
+				std::string_view const line = _buffer.line_view(n, scratch);
 				int actual = indent::leading_whitespace(line.data(), line.data() + line.size(), _buffer.indent().tab_size());
 				if(actual != pair.second)
 					continue;
@@ -1091,13 +1130,14 @@ namespace ng
 
 				indent::fsm_t fsm = indent::create_fsm(_buffer, from, _buffer.indent().indent_size(), _buffer.indent().tab_size());
 
+				std::string scratch;
 				std::multimap<range_t, std::string> replacements;
 				for(size_t n = from; n < to; ++n)
 				{
 					size_t bol = _buffer.begin(n);
 					size_t eos = bol;
 
-					std::string const line = _buffer.substr(bol, _buffer.eol(n));
+					std::string_view const line = _buffer.line_view(n, scratch);
 					if(text::is_blank(line.data(), line.data() + line.size()))
 						continue;
 
@@ -1259,8 +1299,9 @@ namespace ng
 			indent::fsm_t fsm(buffer.indent().indent_size(), buffer.indent().tab_size());
 			if(!fsm.is_seeded(leftOfCaret, patterns))
 			{
+				std::string scratch;
 				size_t n = firstLine;
-				while(n-- > 0 && !fsm.is_seeded(indent::line(buffer, n), indent::patterns_for_line(buffer, n)))
+				while(n-- > 0 && !fsm.is_seeded(buffer.line_view(n, scratch), indent::patterns_for_line(buffer, n)))
 					continue;
 			}
 
@@ -8,12 +8,6 @@ namespace indent
 {
 	std::map<indent::pattern_type, regexp::pattern_t> patterns_for_scope (scope::context_t const& scope);
 
-	template <typename T>
-	std::string line (T const& buf, size_t n)
-	{
-		return buf.substr(buf.begin(n), buf.eol(n));
-	}
-
 	template <typename T>
 	std::map<indent::pattern_type, regexp::pattern_t> patterns_for_line (T const& buf, size_t n)
 	{
@@ -23,8 +17,9 @@ namespace indent
 	template <typename T>
 	fsm_t create_fsm (T const& buf, size_t from, size_t indentSize, size_t tabSize)
 	{
+		std::string scratch;
 		fsm_t fsm(indentSize, tabSize);
-		while(from-- > 0 && !fsm.is_seeded(line(buf, from), patterns_for_line(buf, from)))
+		while(from-- > 0 && !fsm.is_seeded(buf.line_view(from, scratch), patterns_for_line(buf, from)))
 			continue;
 		return fsm;
 	}
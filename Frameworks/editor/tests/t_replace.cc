@@ -0,0 +1,34 @@
+#include <editor/editor.h>
+
+void test_replace_all ()
+{
+	ng::buffer_t buf;
+	ng::editor_t editor(buf);
+	editor.insert("foo bar foo\nfoo");
+
+	ng::ranges_t const res = editor.replace_all("foo", "quux", find::all_matches);
+	OAK_ASSERT_EQ(editor.as_string(), "quux bar quux\nquux");
+	OAK_ASSERT_EQ(to_s(res), "[0-4]&[9-13]&[14-18]");
+	OAK_ASSERT_EQ(buf.lines(), 2);
+
+	editor.replace_all("(u+)", "<$1>", find::regular_expression|find::all_matches);
+	OAK_ASSERT_EQ(editor.as_string(), "q<uu>x bar q<uu>x\nq<uu>x");
+}
+
+void test_multiple_carets ()
+{
+	ng::buffer_t buf;
+	ng::editor_t editor(buf);
+	editor.insert("abc\nabc\nabc");
+
+	ng::ranges_t carets;
+	carets.push_back(ng::index_t(1));
+	carets.push_back(ng::index_t(5));
+	carets.push_back(ng::index_t(9));
+	editor.set_selections(carets);
+
+	editor.insert("x\n");
+	OAK_ASSERT_EQ(editor.as_string(), "ax\nbc\nax\nbc\nax\nbc");
+	OAK_ASSERT_EQ(to_s(editor.ranges()), "[3]&[9]&[15]");
+	OAK_ASSERT_EQ(buf.lines(), 6);
+}
@@ -1,4 +1,5 @@
 #include "bytes.h"
+#include <sys/mman.h>
 
 namespace io
 {
@@ -20,14 +21,32 @@ namespace io
 
 	bytes_t::~bytes_t ()
 	{
-		if(_dispose)
+		release();
+	}
+
+	std::shared_ptr<bytes_t> bytes_t::map (int fd, size_t size)
+	{
+		void* addr = size ? mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		if(addr == MAP_FAILED)
+			return std::shared_ptr<bytes_t>();
+
+		auto res = std::make_shared<bytes_t>((char const*)addr, size, false);
+		res->_mapped = size;
+		return res;
+	}
+
+	void bytes_t::release ()
+	{
+		if(_mapped)
+			munmap(_bytes, _mapped);
+		else if(_dispose)
 			delete[] _bytes;
+		_mapped = 0;
 	}
 
 	void bytes_t::set_string (std::string const& str)
 	{
-		if(_dispose)
-			delete[] _bytes;
+		release();
 		_bytes   = new char[_size = str.size()];
 		_dispose = true;
 		memcpy(_bytes, str.data(), _size);
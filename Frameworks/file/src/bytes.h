@@ -10,6 +10,9 @@ namespace io
 		bytes_t (char const* bytes, size_t size, bool dispose = true);
 		~bytes_t ();
 
+		// Private mapping of the file: pages are loaded on demand and copied only if written to, the file itself is never modified. Pages not written to still reflect changes made to the file, so only map files that no-one else can modify or truncate. Returns nullptr if the file cannot be mapped.
+		static std::shared_ptr<bytes_t> map (int fd, size_t size);
+
 		char* get ()               { return _bytes; };
 		char* begin ()             { return _bytes; };
 		char* end ()               { return _bytes + _size; };
@@ -23,9 +26,12 @@ namespace io
 		uint32_t crc32 () const;
 
 	private:
+		void release ();
+
 		char* _bytes;
 		size_t _size;
 		bool _dispose;
+		size_t _mapped = 0;
 	};
 
 	typedef std::shared_ptr<bytes_t> bytes_ptr;
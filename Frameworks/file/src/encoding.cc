@@ -24,6 +24,8 @@ namespace encoding
 		io::bytes_ptr res;
 		if(from == to)
 			return to == kCharsetUTF8 && !utf8::is_valid(content->begin(), content->end()) ? res : content;
+		else if(from == kCharsetASCII && to == kCharsetUTF8 && std::find_if(content->begin(), content->end(), [](char ch){ return ch & 0x80; }) == content->end())
+			return content; // ASCII is valid UTF-8 so keep the original (possibly mapped) bytes
 
 		if(auto transcode = text::transcode_t(from, to))
 		{
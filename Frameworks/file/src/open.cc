@@ -15,6 +15,7 @@
 #include <text/utf8.h>
 #include <text/newlines.h>
 #include <oak/debug.h>
+#include <sys/clonefile.h>
 
 /*
 	TODO Assign UUID to open request and keep with content
@@ -119,6 +120,29 @@ namespace
 
 namespace file
 {
+	static off_t const kMapFileThreshold = 8*1024*1024;
+
+	// The buffer references the mapped pages, so if the file is modified or truncated while open (e.g. a non-atomic save or log rotation) the text would change under us or crash us on access. We therefore map a private clone that no-one else can reach. Cloning requires APFS and the file to be on the same volume as our temporary folder, otherwise we return nullptr and the file is read into memory.
+	static io::bytes_ptr map_private_clone (int fd)
+	{
+		io::bytes_ptr res;
+
+		std::string const clonePath = path::temp("mapped_file");
+		if(fclonefileat(fd, AT_FDCWD, clonePath.c_str(), 0) == 0)
+		{
+			int cloneFd = ::open(clonePath.c_str(), O_RDONLY|O_CLOEXEC);
+			unlink(clonePath.c_str());
+
+			struct stat sbuf;
+			if(cloneFd != -1 && fstat(cloneFd, &sbuf) != -1 && kMapFileThreshold <= sbuf.st_size)
+				res = io::bytes_t::map(cloneFd, sbuf.st_size);
+
+			if(cloneFd != -1)
+				close(cloneFd);
+		}
+		return res;
+	}
+
 	struct read_t
 	{
 		struct request_t { std::string path; osx::authorization_t authorization; };
@@ -163,10 +187,17 @@ namespace file
 			struct stat sbuf;
 			if(fstat(fd, &sbuf) != -1)
 			{
-				fcntl(fd, F_NOCACHE, 1);
-				result.bytes = std::make_shared<io::bytes_t>(sbuf.st_size);
-				if(read(fd, result.bytes->get(), result.bytes->size()) != sbuf.st_size)
-					result.bytes.reset();
+				// Large files are mapped so the buffer can reference the pages instead of copying them, small files are cheap to copy so we read those
+				if(kMapFileThreshold <= sbuf.st_size && S_ISREG(sbuf.st_mode))
+					result.bytes = map_private_clone(fd);
+
+				if(!result.bytes)
+				{
+					fcntl(fd, F_NOCACHE, 1);
+					result.bytes = std::make_shared<io::bytes_t>(sbuf.st_size);
+					if(read(fd, result.bytes->get(), result.bytes->size()) != sbuf.st_size)
+						result.bytes.reset();
+				}
 			}
 			else
 			{
@@ -70,3 +70,26 @@ void test_encoding_failure ()
 
 	OAK_ASSERT_EQ(cb->_error, true);
 }
+
+void test_large_file_modified_while_open ()
+{
+	test::jail_t jail;
+	std::string content;
+	while(content.size() < 9*1024*1024)
+		content += "lorem ipsum dolor sit amet\n";
+	path::set_content(jail.path("test.txt"), content);
+
+	auto cb = std::make_shared<stall_t>();
+	file::open(jail.path("test.txt"), osx::authorization_t(), cb);
+	cb->wait();
+	OAK_ASSERT_EQ(cb->_error, false);
+
+	// Overwrite in place and truncate like a non-atomic save or copytruncate log rotation would
+	int fd = open(jail.path("test.txt").c_str(), O_WRONLY|O_TRUNC|O_CLOEXEC);
+	OAK_ASSERT_NE(fd, -1);
+	OAK_ASSERT_EQ(write(fd, "changed\n", 8), 8);
+	close(fd);
+
+	OAK_ASSERT_EQ(cb->_content->size(), content.size());
+	OAK_ASSERT(std::equal(content.begin(), content.end(), cb->_content->begin()));
+}
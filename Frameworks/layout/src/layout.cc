@@ -56,10 +56,12 @@ namespace ng
 
 		_buffer_callback = new parser_callback_t(*this);
 		_buffer.add_callback(_buffer_callback);
+		_buffer.add_viewer();
 	}
 
 	layout_t::~layout_t ()
 	{
+		_buffer.remove_viewer();
 		_buffer.remove_callback(_buffer_callback);
 		delete _buffer_callback;
 	}
@@ -416,8 +418,12 @@ namespace ng
 		if(firstY != _rows.begin())
 			--firstY;
 
-		foreach(row, firstY, _rows.lower_bound(yMax, &row_y_comp))
+		auto lastY = _rows.lower_bound(yMax, &row_y_comp);
+		foreach(row, firstY, lastY)
 			update_metrics_for_row(row);
+
+		if(firstY != _rows.end())
+			_buffer.set_priority_range(firstY->offset._length, lastY != _rows.end() ? lastY->offset._length : _buffer.size());
 	}
 
 	bool layout_t::repair_folds (size_t from, size_t to)
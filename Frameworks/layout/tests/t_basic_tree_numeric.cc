@@ -1,5 +1,6 @@
 #include <oak/basic_tree.h>
 #include <oak/oak.h>
+#include <oak/duration.h>
 
 static int numeric_comp (ssize_t key, ssize_t const& offset, ssize_t const& node) { return key < node ? -1 : (key == node ? 0 : +1); }
 // static std::string numeric_to_s (ssize_t const& offset, ssize_t const& node)      { return std::to_string(node); }
@@ -208,3 +209,93 @@ void test_duplicates ()
 
 	OAK_ASSERT(tree.structural_integrity());
 }
+
+void test_node_reuse ()
+{
+	auto keys = create_keys();
+	auto tree = create_tree(keys);
+
+	for(size_t i = 0; i < keys.size(); i += 2)
+		tree.erase(tree.find(keys[i], &numeric_comp));
+	for(size_t i = 0; i < keys.size(); i += 2)
+		tree.insert(tree.lower_bound(keys[i], &numeric_comp), keys[i]);
+
+	OAK_ASSERT(tree.structural_integrity());
+	OAK_ASSERT_EQ(tree.size(), keys.size());
+
+	oak::basic_tree_t<ssize_t> copy;
+	copy.insert(copy.end(), 42);
+	copy = tree;
+	auto const& self = copy;
+	copy = self;
+
+	oak::basic_tree_t<ssize_t> moved(std::move(tree));
+	OAK_ASSERT(tree.empty());
+	tree = std::move(copy);
+
+	std::sort(keys.begin(), keys.end());
+	OAK_ASSERT(std::equal(tree.begin(),  tree.end(),  keys.begin(), &numeric_bin_comp));
+	OAK_ASSERT(std::equal(moved.begin(), moved.end(), keys.begin(), &numeric_bin_comp));
+}
+
+void test_assign ()
+{
+	for(size_t count = 0; count < 500; ++count)
+	{
+		std::vector<std::pair<ssize_t, bool>> pairs;
+		for(size_t i = 0; i < count; ++i)
+			pairs.emplace_back(i, true);
+
+		oak::basic_tree_t<ssize_t> tree;
+		tree.insert(tree.end(), 42);
+		tree.assign(pairs.begin(), pairs.end());
+
+		OAK_ASSERT(tree.structural_integrity());
+		OAK_ASSERT_EQ(tree.size(), count);
+		OAK_ASSERT_EQ(tree.aggregated(), count ? count * (count-1) / 2 : 0);
+		OAK_ASSERT(std::equal(tree.begin(), tree.end(), pairs.begin(), [](oak::basic_tree_t<ssize_t>::value_type const& node, std::pair<ssize_t, bool> const& pair){ return node.key == pair.first; }));
+
+		tree.insert(tree.lower_bound(count / 2, &numeric_comp), count / 2);
+		tree.erase(tree.begin());
+		OAK_ASSERT(tree.structural_integrity());
+	}
+}
+
+void benchmark_million_nodes ()
+{
+	static size_t const kLines = 1000000;
+
+	malloc_statistics_t before, after;
+	malloc_zone_statistics(nullptr, &before);
+
+	oak::duration_t timer;
+	oak::basic_tree_t<ssize_t> tree;
+	for(size_t i = 0; i < kLines; ++i)
+		tree.insert(tree.end(), 20 + i % 60);
+	double const insertTime = timer.duration();
+
+	malloc_zone_statistics(nullptr, &after);
+
+	timer.reset();
+	ssize_t total = 0;
+	for(auto const& node : tree)
+		total += node.key;
+	double const iterateTime = timer.duration();
+	OAK_ASSERT_EQ(total, tree.aggregated());
+
+	timer.reset();
+	for(auto it = tree.begin(); it != tree.end(); )
+	{
+		auto tmp = it;
+		++it;
+		if(it != tree.end())
+			++it;
+		tree.erase(tmp);
+	}
+	for(size_t i = 0; i < kLines / 2; ++i)
+		tree.insert(tree.end(), 20 + i % 60);
+	double const churnTime = timer.duration();
+
+	OAK_ASSERT_EQ(tree.size(), kLines);
+	fprintf(stdout, "%zu nodes: insert %.0f ms, iterate %.1f ms, erase/insert half %.0f ms, %.1f heap bytes per node\n", kLines, insertTime * 1000, iterateTime * 1000, churnTime * 1000, double(after.size_in_use - before.size_in_use) / kLines);
+}
@@ -1,11 +1,16 @@
 #include "grammar.h"
 #include "private.h"
+#include "grammar.capnp.h"
+#include <capnp/message.h>
+#include <capnp/serialize.h>
 #include <bundles/bundles.h>
 #include <plist/plist.h>
 #include <plist/schema.h>
+#include <io/path.h>
 #include <text/format.h>
 #include <oak/oak.h>
 #include <oak/debug.h>
+#include <sys/mman.h>
 
 namespace parse
 {
@@ -89,36 +94,102 @@ namespace parse
 		return false;
 	}
 
-	// =============
-	// = grammar_t =
-	// =============
-
-	static void compile_patterns (rule_t* rule)
+	// Returns the byte all matches must start with, or -1 if we can’t tell (e.g. the pattern starts with a group, a character class, or has top-level alternation)
+	static int pattern_first_byte (std::string const& ptrn)
 	{
-		if(rule->match_string != NULL_STR)
+		if(ptrn.empty())
+			return -1;
+
+		// Case insensitive or extended mode, e.g. (?i) or (?mx:…)
+		for(size_t i = ptrn.find("(?"); i != std::string::npos; i = ptrn.find("(?", i + 2))
 		{
-			rule->match_pattern = regexp::pattern_t(rule->match_string);
-			rule->match_pattern_is_anchored = pattern_has_anchor(rule->match_string);
-			if(!rule->match_pattern)
-				os_log_error(OS_LOG_DEFAULT, "Bad begin/match pattern for %{public}s", rule->scope_string.c_str());
+			size_t j = ptrn.find_first_not_of("imx-", i + 2);
+			if(ptrn.find_first_of("ix", i + 2) < j)
+				return -1;
 		}
 
-		if(rule->while_string != NULL_STR && !pattern_has_back_reference(rule->while_string))
+		size_t depth = 0, classDepth = 0;
+		bool escape = false;
+		for(char const& ch : ptrn)
 		{
-			rule->while_pattern = regexp::pattern_t(rule->while_string);
-			if(!rule->while_pattern)
-				os_log_error(OS_LOG_DEFAULT, "Bad while pattern for %{public}s", rule->scope_string.c_str());
+			if(escape)
+				escape = false;
+			else if(ch == '\\')
+				escape = true;
+			else if(ch == '[')
+				++classDepth;
+			else if(ch == ']' && classDepth)
+				--classDepth;
+			else if(classDepth)
+				continue;
+			else if(ch == '(')
+				++depth;
+			else if(ch == ')' && depth)
+				--depth;
+			else if(ch == '|' && depth == 0)
+				return -1;
 		}
 
-		if(rule->end_string != NULL_STR && !pattern_has_back_reference(rule->end_string))
+		size_t len = 1;
+		unsigned char first = ptrn[0];
+		if(first == '\\')
+		{
+			if(ptrn.size() == 1 || isalnum(ptrn[1]))
+				return -1;
+			first = ptrn[1];
+			len = 2;
+		}
+		else if(strchr("^$.|?*+()[]{}", first))
 		{
-			rule->end_pattern = regexp::pattern_t(rule->end_string);
-			if(!rule->end_pattern)
-				os_log_error(OS_LOG_DEFAULT, "Bad end pattern for %{public}s", rule->scope_string.c_str());
+			return -1;
+		}
+		else if(first & 0x80)
+		{
+			while(len < ptrn.size() && (ptrn[len] & 0xC0) == 0x80)
+				++len;
 		}
 
+		if(len < ptrn.size() && strchr("?*{", ptrn[len]))
+			return -1;
+		return first;
+	}
+
+	// =============
+	// = grammar_t =
+	// =============
+
+	void rule_t::compile_patterns ()
+	{
+		std::call_once(patterns_compiled, [this](){
+			if(match_string != NULL_STR)
+			{
+				match_pattern = regexp::pattern_t(match_string);
+				match_pattern_is_anchored = pattern_has_anchor(match_string);
+				match_pattern_first_byte = pattern_first_byte(match_string);
+				if(!match_pattern)
+					os_log_error(OS_LOG_DEFAULT, "Bad begin/match pattern for %{public}s", scope_string.c_str());
+			}
+
+			if(while_string != NULL_STR && !pattern_has_back_reference(while_string))
+			{
+				while_pattern = regexp::pattern_t(while_string);
+				if(!while_pattern)
+					os_log_error(OS_LOG_DEFAULT, "Bad while pattern for %{public}s", scope_string.c_str());
+			}
+
+			if(end_string != NULL_STR && !pattern_has_back_reference(end_string))
+			{
+				end_pattern = regexp::pattern_t(end_string);
+				if(!end_pattern)
+					os_log_error(OS_LOG_DEFAULT, "Bad end pattern for %{public}s", scope_string.c_str());
+			}
+		});
+	}
+
+	static void setup_injections (rule_t* rule)
+	{
 		for(rule_ptr child : rule->children)
-			compile_patterns(child.get());
+			setup_injections(child.get());
 
 		repository_ptr maps[] = { rule->repository, rule->injection_rules, rule->captures, rule->begin_captures, rule->while_captures, rule->end_captures };
 		for(auto const& map : maps)
@@ -127,7 +198,7 @@ namespace parse
 				continue;
 
 			for(auto const& pair : *map)
-				compile_patterns(pair.second.get());
+				setup_injections(pair.second.get());
 		}
 
 		if(rule->injection_rules)
@@ -203,25 +274,40 @@ namespace parse
 		auto it = _grammars.find(scope);
 		if(it != _grammars.end())
 			return it->second;
-		for(auto item : bundles::query(bundles::kFieldGrammarScope, scope, scope::wildcard, bundles::kItemTypeGrammar))
-			return add_grammar(scope, item->plist(), base);
-		return rule_ptr();
+
+		auto const items = bundles::query(bundles::kFieldGrammarScope, scope, scope::wildcard, bundles::kItemTypeGrammar);
+		_dependencies.scopes.emplace_back(scope, items.empty() ? "" : to_s(items.front()->uuid()));
+		if(items.empty())
+			return rule_ptr();
+
+		_dependencies.add_item(items.front());
+		return add_grammar(scope, items.front()->plist(), base);
+	}
+
+	static std::vector<bundles::item_ptr> injection_grammar_items ()
+	{
+		std::vector<bundles::item_ptr> res;
+		for(auto item : bundles::query(bundles::kFieldAny, NULL_STR, scope::wildcard, bundles::kItemTypeGrammar))
+		{
+			if(item->value_for_field(bundles::kFieldGrammarInjectionSelector) != NULL_STR)
+				res.push_back(item);
+		}
+		return res;
 	}
 
 	std::vector<std::pair<scope::selector_t, rule_ptr>> grammar_t::injection_grammars ()
 	{
 		std::vector<std::pair<scope::selector_t, rule_ptr>> res;
-		for(auto item : bundles::query(bundles::kFieldAny, NULL_STR, scope::wildcard, bundles::kItemTypeGrammar))
+		for(auto item : injection_grammar_items())
 		{
-			std::string injectionSelector = item->value_for_field(bundles::kFieldGrammarInjectionSelector);
-			if(injectionSelector != NULL_STR)
+			_dependencies.injection_grammars.push_back(to_s(item->uuid()));
+			_dependencies.add_item(item);
+
+			if(rule_ptr grammar = convert_plist(item->plist()))
 			{
-				if(rule_ptr grammar = convert_plist(item->plist()))
-				{
-					setup_includes(grammar, grammar, grammar, rule_stack_t(grammar.get()));
-					compile_patterns(grammar.get());
-					res.emplace_back(injectionSelector, grammar);
-				}
+				setup_includes(grammar, grammar, grammar, rule_stack_t(grammar.get()));
+				setup_injections(grammar.get());
+				res.emplace_back(item->value_for_field(bundles::kFieldGrammarInjectionSelector), grammar);
 			}
 		}
 		return res;
@@ -234,11 +320,344 @@ namespace parse
 		{
 			_grammars.emplace(scope, grammar);
 			setup_includes(grammar, base ?: grammar, grammar, rule_stack_t(grammar.get()));
-			compile_patterns(grammar.get());
+			setup_injections(grammar.get());
 		}
 		return grammar;
 	}
 
+	// ==================
+	// = dependencies_t =
+	// ==================
+
+	static std::vector<grammar_t::dependencies_t::file_t> files_for_item (bundles::item_ptr const& item)
+	{
+		std::vector<grammar_t::dependencies_t::file_t> res;
+		for(auto const& path : item->paths())
+		{
+			struct stat buf;
+			if(stat(path.c_str(), &buf) == 0)
+					res.push_back({ path, buf.st_mtimespec.tv_sec * 1000000000LL + buf.st_mtimespec.tv_nsec, buf.st_size, buf.st_ino });
+			else	res.push_back({ path, -1, -1, 0 });
+		}
+		return res;
+	}
+
+	void grammar_t::dependencies_t::add_item (bundles::item_ptr const& item)
+	{
+		files.emplace(to_s(item->uuid()), files_for_item(item));
+	}
+
+	bool grammar_t::dependencies_t::is_current () const
+	{
+		for(auto const& pair : scopes)
+		{
+			auto const items = bundles::query(bundles::kFieldGrammarScope, pair.first, scope::wildcard, bundles::kItemTypeGrammar);
+			if(pair.second != (items.empty() ? "" : to_s(items.front()->uuid())))
+				return false;
+		}
+
+		std::vector<std::string> injectionGrammars;
+		for(auto item : injection_grammar_items())
+			injectionGrammars.push_back(to_s(item->uuid()));
+		if(injectionGrammars != injection_grammars)
+			return false;
+
+		for(auto const& pair : files)
+		{
+			bundles::item_ptr item = bundles::lookup(oak::uuid_t(pair.first));
+			if(!item || files_for_item(item) != pair.second)
+				return false;
+		}
+		return true;
+	}
+
+	// =================
+	// = Grammar Cache =
+	// =================
+
+	static uint32_t const kGrammarCacheFormatVersion = 2;
+
+	static std::mutex CachePathMutex;
+	static std::string CachePath = NULL_STR;
+
+	static std::string cache_path ()
+	{
+		std::lock_guard<std::mutex> lock(CachePathMutex);
+		return CachePath;
+	}
+
+	template <typename _ListBuilder>
+	static void write_entries (_ListBuilder dst, repository_t const& src, std::map<rule_t const*, uint32_t> const& indices)
+	{
+		size_t i = 0;
+		for(auto const& pair : src)
+		{
+			dst[i].setKey(pair.first);
+			dst[i].setRule(indices.at(pair.second.get()));
+			++i;
+		}
+	}
+
+	static repository_ptr read_entries (capnp::List<Rule::Entry>::Reader src, std::vector<rule_ptr> const& rules)
+	{
+		auto res = std::make_shared<repository_t>();
+		for(auto entry : src)
+			res->emplace(std::string(entry.getKey()), rules.at(entry.getRule()));
+		return res;
+	}
+
+	void grammar_t::save_cache (std::string const& path) const
+	{
+		for(auto const& pair : _dependencies.files)
+		{
+			if(pair.second.empty()) // in-memory items, we can’t tell when they change
+				return;
+		}
+
+		// Number all rules reachable from the root or one of the loaded grammars, these include each other so we need to know all indices before writing the rules
+		std::vector<rule_t const*> rules;
+		std::map<rule_t const*, uint32_t> indices;
+		auto index = [&](rule_t const* rule){
+			if(indices.emplace(rule, rules.size()).second)
+				rules.push_back(rule);
+		};
+
+		index(_rule.get());
+		for(auto const& pair : _grammars)
+			index(pair.second.get());
+
+		for(size_t i = 0; i < rules.size(); ++i)
+		{
+			rule_t const* rule = rules[i];
+			if(rule->include)
+				index(rule->include);
+			for(auto const& child : rule->children)
+				index(child.get());
+			for(auto const& map : { rule->captures, rule->begin_captures, rule->while_captures, rule->end_captures, rule->repository })
+			{
+				if(map)
+				{
+					for(auto const& pair : *map)
+						index(pair.second.get());
+				}
+			}
+			for(auto const& pair : rule->injections)
+				index(pair.second.get());
+		}
+
+		capnp::MallocMessageBuilder message;
+		auto grammar = message.initRoot<Grammar>();
+		grammar.setVersion(kGrammarCacheFormatVersion);
+
+		auto dstRules = grammar.initRules(rules.size());
+		for(size_t i = 0; i < rules.size(); ++i)
+		{
+			rule_t const* src = rules[i];
+			auto dst = dstRules[i];
+
+			if(src->scope_string != NULL_STR)
+				dst.setScope(src->scope_string);
+			if(src->content_scope_string != NULL_STR)
+				dst.setContentScope(src->content_scope_string);
+			if(src->match_string != NULL_STR)
+				dst.setMatch(src->match_string);
+			if(src->while_string != NULL_STR)
+				dst.setWhilePattern(src->while_string);
+			if(src->end_string != NULL_STR)
+				dst.setEndPattern(src->end_string);
+			if(src->apply_end_last != NULL_STR)
+				dst.setApplyEndLast(src->apply_end_last);
+			if(src->include_string != NULL_STR)
+				dst.setInclude(src->include_string);
+			if(src->include)
+				dst.setIncludeRule(indices.at(src->include));
+
+			auto children = dst.initChildren(src->children.size());
+			for(size_t j = 0; j < src->children.size(); ++j)
+				children.set(j, indices.at(src->children[j].get()));
+
+			if(src->captures)
+				write_entries(dst.initCaptures(src->captures->size()), *src->captures, indices);
+			if(src->begin_captures)
+				write_entries(dst.initBeginCaptures(src->begin_captures->size()), *src->begin_captures, indices);
+			if(src->while_captures)
+				write_entries(dst.initWhileCaptures(src->while_captures->size()), *src->while_captures, indices);
+			if(src->end_captures)
+				write_entries(dst.initEndCaptures(src->end_captures->size()), *src->end_captures, indices);
+			if(src->repository)
+				write_entries(dst.initRepository(src->repository->size()), *src->repository, indices);
+
+			auto injections = dst.initInjections(src->injections.size());
+			for(size_t j = 0; j < src->injections.size(); ++j)
+			{
+				injections[j].setSelector(to_s(src->injections[j].first));
+				injections[j].setRule(indices.at(src->injections[j].second.get()));
+			}
+		}
+
+		auto grammars = grammar.initGrammars(_grammars.size());
+		size_t i = 0;
+		for(auto const& pair : _grammars)
+		{
+			grammars[i].setKey(pair.first);
+			grammars[i].setRule(indices.at(pair.second.get()));
+			++i;
+		}
+
+		auto scopes = grammar.initScopes(_dependencies.scopes.size());
+		for(size_t j = 0; j < _dependencies.scopes.size(); ++j)
+		{
+			scopes[j].setScope(_dependencies.scopes[j].first);
+			scopes[j].setUuid(_dependencies.scopes[j].second);
+		}
+
+		auto injectionGrammars = grammar.initInjectionGrammars(_dependencies.injection_grammars.size());
+		for(size_t j = 0; j < _dependencies.injection_grammars.size(); ++j)
+			injectionGrammars.set(j, _dependencies.injection_grammars[j]);
+
+		auto items = grammar.initItems(_dependencies.files.size());
+		i = 0;
+		for(auto const& pair : _dependencies.files)
+		{
+			auto item = items[i++];
+			item.setUuid(pair.first);
+			auto files = item.initFiles(pair.second.size());
+			for(size_t j = 0; j < pair.second.size(); ++j)
+			{
+				files[j].setPath(pair.second[j].path);
+				files[j].setModified(pair.second[j].modified);
+				files[j].setSize(pair.second[j].size);
+				files[j].setInode(pair.second[j].inode);
+			}
+		}
+
+		// Write to a temporary file and rename it so that other grammars never read a partially written cache
+		mkdir(path::parent(path).c_str(), S_IRWXU);
+		std::string tmp = path + ".XXXXXX";
+		int fd = mkstemp(&tmp[0]);
+		if(fd == -1)
+		{
+			os_log_error(OS_LOG_DEFAULT, "Unable to create ‘%{public}s’: %{public}s", tmp.c_str(), strerror(errno));
+			return;
+		}
+
+		// The cache is only an optimization so failing to write it (e.g. disk full) must not throw out of set_item() while the grammar is locked
+		try {
+			capnp::writeMessageToFd(fd, message);
+		}
+		catch(kj::Exception const& e) {
+			os_log_error(OS_LOG_DEFAULT, "Unable to write ‘%{public}s’: %{public}s", tmp.c_str(), e.getDescription().cStr());
+			close(fd);
+			unlink(tmp.c_str());
+			return;
+		}
+
+		close(fd);
+		if(rename(tmp.c_str(), path.c_str()) == -1)
+		{
+			os_log_error(OS_LOG_DEFAULT, "Unable to rename ‘%{public}s’: %{public}s", tmp.c_str(), strerror(errno));
+			unlink(tmp.c_str());
+		}
+	}
+
+	bool grammar_t::load_cache (std::string const& path)
+	{
+		int fd = open(path.c_str(), O_RDONLY|O_CLOEXEC);
+		if(fd == -1)
+			return false;
+
+		struct stat buf;
+		void* mem = fstat(fd, &buf) == 0 && buf.st_size > 0 && buf.st_size % sizeof(capnp::word) == 0 ? mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+		if(mem == MAP_FAILED)
+			return false;
+
+		bool res = false;
+		try {
+			capnp::FlatArrayMessageReader message(kj::ArrayPtr<capnp::word const>((capnp::word const*)mem, buf.st_size / sizeof(capnp::word)));
+			auto grammar = message.getRoot<Grammar>();
+			if(grammar.getVersion() != kGrammarCacheFormatVersion)
+			{
+				os_log_error(OS_LOG_DEFAULT, "Skip ‘%{public}s’ version %u (expected %u)", path.c_str(), grammar.getVersion(), kGrammarCacheFormatVersion);
+			}
+			else if(grammar.getRules().size() != 0)
+			{
+				dependencies_t dependencies;
+				for(auto scope : grammar.getScopes())
+					dependencies.scopes.emplace_back(std::string(scope.getScope()), std::string(scope.getUuid()));
+				for(auto uuid : grammar.getInjectionGrammars())
+					dependencies.injection_grammars.emplace_back(std::string(uuid));
+				for(auto item : grammar.getItems())
+				{
+					auto& files = dependencies.files[std::string(item.getUuid())];
+					for(auto file : item.getFiles())
+						files.push_back({ std::string(file.getPath()), file.getModified(), file.getSize(), file.getInode() });
+				}
+
+				if(dependencies.is_current())
+				{
+					auto const src = grammar.getRules();
+
+					std::vector<rule_ptr> rules;
+					for(size_t i = 0; i < src.size(); ++i)
+						rules.push_back(std::make_shared<rule_t>());
+
+					for(size_t i = 0; i < src.size(); ++i)
+					{
+						auto const& rule = rules[i];
+						if(src[i].hasScope())
+							rule->scope_string = std::string(src[i].getScope());
+						if(src[i].hasContentScope())
+							rule->content_scope_string = std::string(src[i].getContentScope());
+						if(src[i].hasMatch())
+							rule->match_string = std::string(src[i].getMatch());
+						if(src[i].hasWhilePattern())
+							rule->while_string = std::string(src[i].getWhilePattern());
+						if(src[i].hasEndPattern())
+							rule->end_string = std::string(src[i].getEndPattern());
+						if(src[i].hasApplyEndLast())
+							rule->apply_end_last = std::string(src[i].getApplyEndLast());
+						if(src[i].hasInclude())
+							rule->include_string = std::string(src[i].getInclude());
+						if(src[i].getIncludeRule() != -1)
+							rule->include = rules.at(src[i].getIncludeRule()).get();
+
+						for(auto child : src[i].getChildren())
+							rule->children.push_back(rules.at(child));
+
+						if(src[i].hasCaptures())
+							rule->captures = read_entries(src[i].getCaptures(), rules);
+						if(src[i].hasBeginCaptures())
+							rule->begin_captures = read_entries(src[i].getBeginCaptures(), rules);
+						if(src[i].hasWhileCaptures())
+							rule->while_captures = read_entries(src[i].getWhileCaptures(), rules);
+						if(src[i].hasEndCaptures())
+							rule->end_captures = read_entries(src[i].getEndCaptures(), rules);
+						if(src[i].hasRepository())
+							rule->repository = read_entries(src[i].getRepository(), rules);
+
+						for(auto injection : src[i].getInjections())
+							rule->injections.emplace_back(std::string(injection.getSelector()), rules.at(injection.getRule()));
+					}
+
+					_grammars.clear();
+					for(auto entry : grammar.getGrammars())
+						_grammars.emplace(std::string(entry.getKey()), rules.at(entry.getRule()));
+
+					_rule         = rules.front();
+					_dependencies = std::move(dependencies);
+					res = true;
+				}
+			}
+		}
+		catch(std::exception const& e) {
+			os_log_error(OS_LOG_DEFAULT, "Exception thrown while loading ‘%{public}s’: %{public}s", path.c_str(), e.what());
+		}
+
+		munmap(mem, buf.st_size);
+		return res;
+	}
+
 	grammar_t::grammar_t (bundles::item_ptr const& grammarItem) : _bundles_callback(*this)
 	{
 		bundles::add_callback(&_bundles_callback);
@@ -253,21 +672,38 @@ namespace parse
 	void grammar_t::set_item (bundles::item_ptr const& item)
 	{
 		ASSERT(item);
+
+		std::unique_lock<std::shared_mutex> lock(_mutex);
 		_grammars.clear();
+		_dependencies = dependencies_t();
 
 		_item  = item;
-		_plist = item->plist();
-		_rule  = add_grammar(item->value_for_field(bundles::kFieldGrammarScope), _plist);
+		_plist = plist::dictionary_t();
 
-		if(!_rule)
+		std::string cachePath = cache_path();
+		if(cachePath != NULL_STR)
+			cachePath = item->paths().empty() ? NULL_STR : path::join(cachePath, to_s(item->uuid()) + ".binary");
+		if(cachePath == NULL_STR || !load_cache(cachePath))
 		{
-			os_log_error(OS_LOG_DEFAULT, "Grammar missing for ‘%{public}s’", _item->name().c_str());
-			_rule = std::make_shared<rule_t>();
-		}
+			_dependencies.add_item(item);
+			_plist = item->plist();
+			_rule  = add_grammar(item->value_for_field(bundles::kFieldGrammarScope), _plist);
 
-		auto const grammars = injection_grammars();
-		_rule->injections.insert(_rule->injections.end(), grammars.begin(), grammars.end());
+			if(_rule)
+			{
+				auto const grammars = injection_grammars();
+				_rule->injections.insert(_rule->injections.end(), grammars.begin(), grammars.end());
+				if(cachePath != NULL_STR)
+					save_cache(cachePath);
+			}
+			else
+			{
+				os_log_error(OS_LOG_DEFAULT, "Grammar missing for ‘%{public}s’", _item->name().c_str());
+				_rule = std::make_shared<rule_t>();
+			}
+		}
 		_rule->is_root = true;
+		lock.unlock();
 
 		_callbacks(&callback_t::grammar_did_change);
 	}
@@ -285,8 +721,9 @@ namespace parse
 
 	void grammar_t::bundles_did_change ()
 	{
+		// When loaded from the cache we did not read the plist, instead we check if the grammar or any it includes have changed on disk
 		bundles::item_ptr newItem = bundles::lookup(uuid());
-		if(newItem && !plist::equal(_plist, newItem->plist())) // FIXME this is a kludge, ideally we should register as callback for the bundle item (when that is supported)
+		if(newItem && (_plist.empty() ? !_dependencies.is_current() : !plist::equal(_plist, newItem->plist()))) // FIXME this is a kludge, ideally we should register as callback for the bundle item (when that is supported)
 			set_item(newItem);
 	}
 
@@ -300,4 +737,10 @@ namespace parse
 		return std::make_shared<grammar_t>(grammarItem);
 	}
 
+	void set_grammar_cache_path (std::string const& path)
+	{
+		std::lock_guard<std::mutex> lock(CachePathMutex);
+		CachePath = path;
+	}
+
 } /* parse */
@@ -3,6 +3,7 @@
 
 #include <bundles/bundles.h>
 #include <oak/callbacks.h>
+#include <shared_mutex>
 
 namespace parse
 {
@@ -30,7 +31,8 @@ namespace parse
 		void add_callback (callback_t* cb)      { _callbacks.add(cb);    }
 		void remove_callback (callback_t* cb)   { _callbacks.remove(cb); }
 
-		std::mutex& mutex () { return _mutex; }
+		// Parsers should hold a shared lock, the rules are only mutated while holding an exclusive lock
+		std::shared_mutex& mutex () { return _mutex; }
 
 	private:
 		struct bundles_callback_t : bundles::callback_t
@@ -49,6 +51,32 @@ namespace parse
 			rule_stack_t const* parent;
 		};
 
+		// The grammar items that the rules were built from, so that we can tell whether a cached version is still valid
+		struct dependencies_t
+		{
+			// A file is considered unchanged when all of these are, as the modification date alone misses edits within its resolution and files replaced by others with an older date
+			struct file_t
+			{
+				std::string path;
+				int64_t modified; // nanoseconds, -1 if the file could not be read
+				int64_t size;
+				uint64_t inode;
+
+				bool operator== (file_t const& rhs) const { return path == rhs.path && modified == rhs.modified && size == rhs.size && inode == rhs.inode; }
+				bool operator!= (file_t const& rhs) const { return !(*this == rhs); }
+			};
+
+			std::vector<std::pair<std::string, std::string>> scopes;                        // scopes looked up for includes and UUID of the grammar found (empty if none)
+			std::vector<std::string> injection_grammars;                                   // UUIDs of grammars with an injection selector
+			std::map<std::string, std::vector<file_t>> files;                              // UUID → files of each grammar used
+
+			void add_item (bundles::item_ptr const& item);
+			bool is_current () const;
+		};
+
+		bool load_cache (std::string const& path);
+		void save_cache (std::string const& path) const;
+
 		void setup_includes (rule_ptr const& rule, rule_ptr const& base, rule_ptr const& self, rule_stack_t const& stack);
 		rule_ptr find_grammar (std::string const& scope, rule_ptr const& base);
 		rule_ptr add_grammar (std::string const& scope, plist::any_t const& plist, rule_ptr const& base = rule_ptr());
@@ -62,12 +90,16 @@ namespace parse
 		oak::callbacks_t<callback_t> _callbacks;
 		rule_ptr _rule;
 		std::map<std::string, rule_ptr> _grammars;
-		std::mutex _mutex;
+		dependencies_t _dependencies;
+		std::shared_mutex _mutex;
 	};
 
 	typedef std::shared_ptr<grammar_t> grammar_ptr;
 	grammar_ptr parse_grammar (bundles::item_ptr const& grammarItem);
 
+	// Grammars are saved to this folder with includes resolved so that next time they can be loaded without reading the plists of the grammar and those it includes (no caching until set)
+	void set_grammar_cache_path (std::string const& path);
+
 } /* parse */
 
 #endif /* end of include guard: LOAD_GRAMMAR_H_FPR2TQML */
@@ -3,10 +3,10 @@
 #include <regexp/regexp.h>
 #include <regexp/format_string.h>
 #include <bundles/bundles.h>
-#include <text/utf8.h>
 #include <oak/oak.h>
+#include <unordered_set>
 
-static size_t const kParserMaxLineSize = 4096;
+static size_t const kScannerCacheSize = 256;
 
 namespace
 {
@@ -89,7 +89,33 @@ namespace
 
 namespace parse
 {
-	size_t rule_t::rule_id_counter = 0;
+	std::atomic_size_t rule_t::rule_id_counter(0);
+
+	// Only used for statistics, so relaxed increments are enough and avoid contention between concurrent parsers
+	static std::atomic_size_t BytesParsed(0);
+	static std::atomic_size_t RegexpSearches(0);
+	static std::atomic_size_t RegexpSearchesSkipped(0);
+
+	statistics_t statistics ()
+	{
+		return { BytesParsed.load(std::memory_order_relaxed), RegexpSearches.load(std::memory_order_relaxed), RegexpSearchesSkipped.load(std::memory_order_relaxed) };
+	}
+
+	static regexp::match_t search_pattern (regexp::pattern_t const& ptrn, char const* first, char const* last, char const* from, char const* to, OnigOptionType options = ONIG_OPTION_NONE)
+	{
+		RegexpSearches.fetch_add(1, std::memory_order_relaxed);
+		return regexp::search(ptrn, first, last, from, to, options);
+	}
+
+	static regexp::match_t search_rule (rule_t const* rule, char const* first, char const* last, size_t i, OnigOptionType options)
+	{
+		if(rule->match_pattern_first_byte != -1 && !memchr(first + i, rule->match_pattern_first_byte, last - (first + i)))
+		{
+			RegexpSearchesSkipped.fetch_add(1, std::memory_order_relaxed);
+			return regexp::match_t();
+		}
+		return search_pattern(rule->match_pattern, first, last, first + i, last, options);
+	}
 
 	bool equal (stack_ptr lhs, stack_ptr rhs)
 	{
@@ -236,33 +262,67 @@ namespace parse
 		}
 	}
 
+	// ===================
+	// = Rule Collection =
+	// ===================
+
+	// Tracks which rules have been collected for the current context. This is kept per thread rather than in rule_t so that the grammar is immutable after setup and can be shared by parsers running concurrently. Rule ids keep growing as grammars are reloaded so we store the rules seen rather than index by id, this way memory use is bounded by the largest context.
+	struct collect_state_t
+	{
+		void reset ()
+		{
+			_rules.clear();
+		}
+
+		bool included (rule_t const* rule) const
+		{
+			return _rules.find(rule) != _rules.end();
+		}
+
+		void include (rule_t const* rule)
+		{
+			_rules.insert(rule);
+		}
+
+	private:
+		std::unordered_set<rule_t const*> _rules;
+	};
+
+	static collect_state_t& collect_state ()
+	{
+		thread_local collect_state_t state;
+		return state;
+	}
+
 	static void collect_children (std::vector<rule_ptr> const& children, std::vector<rule_t*>& res, std::vector<rule_t*>* groups);
 
 	static void collect_rule (rule_t* rule, std::vector<rule_t*>& res, std::vector<rule_t*>* groups)
 	{
-		while(rule && rule->include && !rule->included)
+		collect_state_t& state = collect_state();
+		while(rule && rule->include && !state.included(rule))
 		{
 			if(groups)
 			{
-				rule->included = true;
+				state.include(rule);
 				groups->push_back(rule);
 			}
 			rule = rule->include;
 		}
 
-		if(!rule || rule->included)
+		if(!rule || state.included(rule))
 			return;
 
+		rule->compile_patterns();
 		if(rule->match_pattern)
 		{
-			rule->included = true;
+			state.include(rule);
 			res.push_back(rule);
 		}
 		else if(!rule->children.empty())
 		{
 			if(groups)
 			{
-				rule->included = true;
+				state.include(rule);
 				groups->push_back(rule);
 			}
 
@@ -304,8 +364,6 @@ namespace parse
 	{
 		for(rule_t* rule : rules)
 		{
-			rule->included = false;
-
 			auto it = match_cache.find(rule->rule_id);
 			if(it != match_cache.end())
 			{
@@ -314,7 +372,7 @@ namespace parse
 			}
 			else
 			{
-				auto match = regexp::search(rule->match_pattern, first, last, first + i, last, options);
+				auto match = search_rule(rule, first, last, i, options);
 				if(!rule->match_pattern_is_anchored)
 					match_cache.emplace(rule->rule_id, match);
 				if(match)
@@ -324,15 +382,47 @@ namespace parse
 		return rank;
 	}
 
-	static void collect_rules (char const* first, char const* last, size_t i, bool firstLine, stack_ptr const& stack, std::set<ranked_match_t>& res, std::map<size_t, regexp::match_t>& match_cache)
+	// Guards rule_t::scanners which, unlike the rest of the grammar, is updated while parsing
+	static std::shared_mutex& scanner_mutex ()
 	{
-		std::vector<rule_t*> rules, groups, injectedRulesPre, injectedRulesPost;
-		collect_children(stack->rule->children, rules, &groups);
-		collect_injections(stack, scope::context_t(stack->scope, ""), groups, injectedRulesPre);
-		collect_injections(stack, scope::context_t("", stack->scope), groups, injectedRulesPost);
+		static std::shared_mutex mutex;
+		return mutex;
+	}
 
-		for(rule_t* rule : groups)
-			rule->included = false;
+	static scanner_ptr scanner_for (stack_ptr const& stack)
+	{
+		scanner_t::key_t key = { stack->scope };
+		for(stack_ptr node = stack; node; node = node->parent)
+		{
+			if(!node->rule->injections.empty())
+				key.injectors.push_back(node->rule);
+		}
+
+		std::map<scanner_t::key_t, scanner_ptr>& cache = stack->rule->scanners;
+		{
+			std::shared_lock<std::shared_mutex> lock(scanner_mutex());
+			auto it = cache.find(key);
+			if(it != cache.end())
+				return it->second;
+		}
+
+		collect_state().reset();
+
+		auto res = std::make_shared<scanner_t>();
+		std::vector<rule_t*> groups;
+		collect_children(stack->rule->children, res->rules, &groups);
+		collect_injections(stack, scope::context_t(stack->scope, ""), groups, res->injected_rules_pre);
+		collect_injections(stack, scope::context_t("", stack->scope), groups, res->injected_rules_post);
+
+		std::unique_lock<std::shared_mutex> lock(scanner_mutex());
+		if(cache.size() >= kScannerCacheSize) // scope names with captures can yield an unbounded number of contexts
+			cache.clear();
+		return cache.emplace(std::move(key), res).first->second;
+	}
+
+	static void collect_rules (char const* first, char const* last, size_t i, bool firstLine, stack_ptr const& stack, std::set<ranked_match_t>& res, std::map<size_t, regexp::match_t>& match_cache)
+	{
+		scanner_ptr scanner = scanner_for(stack);
 
 		// ============================
 		// = Match rules against text =
@@ -341,17 +431,17 @@ namespace parse
 		res.clear();
 		OnigOptionType const options = anchor_options(firstLine, stack->anchor == i, first, last);
 
-		size_t rank = apply_rules(0, injectedRulesPre, first, last, options, i, res, match_cache);
+		size_t rank = apply_rules(0, scanner->injected_rules_pre, first, last, options, i, res, match_cache);
 		size_t endPatternRank = ++rank;
-		rank = apply_rules(rank, rules, first, last, options, i, res, match_cache);
+		rank = apply_rules(rank, scanner->rules, first, last, options, i, res, match_cache);
 
 		if(stack->end_pattern)
 		{
-			if(regexp::match_t const& match = regexp::search(stack->end_pattern, first, last, first + i, last, options))
+			if(regexp::match_t const& match = search_pattern(stack->end_pattern, first, last, first + i, last, options))
 				res.emplace(stack->rule, match, stack->apply_end_last ? ++rank : endPatternRank, true);
 		}
 
-		rank = apply_rules(rank, injectedRulesPost, first, last, options, i, res, match_cache);
+		rank = apply_rules(rank, scanner->injected_rules_post, first, last, options, i, res, match_cache);
 	}
 
 	static bool has_cycle (size_t rule_id, size_t i, stack_ptr const& stack)
@@ -363,12 +453,9 @@ namespace parse
 		return stack->parent ? has_cycle(rule_id, i, stack->parent) : false;
 	}
 
-	static stack_ptr parse (char const* first, char const* last, stack_ptr stack, scopes_t& scopes, bool firstLine, size_t i)
+	// Apply the ‘while’ patterns of the contexts we are in at the start of a line, leaving those that no longer match, and return the resulting scope
+	static scope::scope_t apply_while_rules (char const* first, char const* last, stack_ptr& stack, scopes_t& scopes, bool firstLine, size_t& i)
 	{
-		// ==============================
-		// = apply the ‘while’ patterns =
-		// ==============================
-
 		std::vector<stack_ptr> while_rules;
 		for(stack_ptr node = stack; node->while_pattern; node = node->parent)
 		{
@@ -382,7 +469,7 @@ namespace parse
 		scope::scope_t scope = while_rules.empty() ? stack->scope : while_rules.back()->parent->scope;
 		riterate(it, while_rules)
 		{
-			if(regexp::match_t const& m = regexp::search((*it)->while_pattern, first, last, first + i))
+			if(regexp::match_t const& m = search_pattern((*it)->while_pattern, first, last, first + i, last))
 			{
 				rule_t const* rule = (*it)->rule;
 				if(rule->scope_string != NULL_STR)
@@ -411,10 +498,12 @@ namespace parse
 			break;
 		}
 
-		// ======================
-		// = Parse rest of line =
-		// ======================
+		return scope;
+	}
 
+	// Parse the rest of the line from i. Returns false when stopping at a context change or after a match rule at or after stopAt, in which case stack, scope, and i are updated so that calling again continues where we stopped. Stopping right before collecting rules means nothing else needs to be saved.
+	static bool parse_until (char const* first, char const* last, stack_ptr& stack, scope::scope_t& scope, scopes_t& scopes, bool firstLine, size_t& i, size_t stopAt)
+	{
 		std::set<ranked_match_t> rules;
 		std::map<size_t, regexp::match_t> match_cache;
 		collect_rules(first, last, i, firstLine, stack, rules, match_cache);
@@ -426,8 +515,8 @@ namespace parse
 
 			if(m.match.begin() < i)
 			{
-				regexp::pattern_t const& ptrn = m.is_end_pattern ? stack->end_pattern : m.rule->match_pattern;
-				if(m.match = regexp::search(ptrn, first, last, first + i, last, anchor_options(firstLine, stack->anchor == i, first, last)))
+				OnigOptionType const options = anchor_options(firstLine, stack->anchor == i, first, last);
+				if(m.match = m.is_end_pattern ? search_pattern(stack->end_pattern, first, last, first + i, last, options) : search_rule(m.rule, first, last, i, options))
 					rules.insert(m);
 				continue;
 			}
@@ -510,25 +599,68 @@ namespace parse
 
 				apply_captures(scope, m.match, rule->captures, scopes, firstLine);
 
-				if(m.match = regexp::search(m.rule->match_pattern, first, last, first + i, last, anchor_options(firstLine, stack->anchor == i, first, last)))
+				if(stopAt <= i) // a line can consist of only match rules, so we must also be able to stop here, collecting the rules again when we continue finds the same matches
+					return false;
+
+				if(m.match = search_rule(m.rule, first, last, i, anchor_options(firstLine, stack->anchor == i, first, last)))
 					rules.insert(m);
 
 				continue; // no context change, so skip finding rules for this context
 			}
 
+			if(stopAt <= i)
+				return false;
+
 			collect_rules(first, last, i, firstLine, stack, rules, match_cache);
 		}
 		stack->anchor = first + stack->anchor == last ? 0 : SIZE_T_MAX;
+		return true;
+	}
+
+	static stack_ptr parse (char const* first, char const* last, stack_ptr stack, scopes_t& scopes, bool firstLine, size_t i)
+	{
+		scope::scope_t scope = apply_while_rules(first, last, stack, scopes, firstLine, i);
+		parse_until(first, last, stack, scope, scopes, firstLine, i, SIZE_T_MAX);
 		return stack;
 	}
 
-	stack_ptr parse (char const* first, char const* last, stack_ptr stack, std::map<size_t, scope::scope_t>& map, bool firstLine)
+	struct line_progress_t
 	{
+		scope::scope_t line_scope; // scope at the start of the line, scope changes are relative to this
+		stack_ptr stack;
+		scope::scope_t scope;
 		scopes_t scopes;
-		if(last - first > kParserMaxLineSize)
-			last = utf8::find_safe_end(first, first + kParserMaxLineSize);
-		auto res = parse(first, last, stack, scopes, firstLine, 0);
-		res->scope = scopes.update(stack->scope, map);
+		size_t position = 0;
+	};
+
+	stack_ptr parse (char const* first, char const* last, stack_ptr stack, std::map<size_t, scope::scope_t>& map, bool firstLine)
+	{
+		line_progress_ptr progress;
+		return parse(first, last, stack, map, firstLine, SIZE_T_MAX, progress);
+	}
+
+	stack_ptr parse (char const* first, char const* last, stack_ptr stack, std::map<size_t, scope::scope_t>& map, bool firstLine, size_t byteLimit, line_progress_ptr& progress)
+	{
+		if(!progress)
+		{
+			progress = std::make_shared<line_progress_t>();
+			progress->line_scope = stack->scope;
+			progress->stack      = stack;
+			progress->scope      = apply_while_rules(first, last, progress->stack, progress->scopes, firstLine, progress->position);
+		}
+
+		size_t const from   = progress->position;
+		size_t const stopAt = byteLimit < SIZE_T_MAX - from ? from + byteLimit : SIZE_T_MAX;
+		if(!parse_until(first, last, progress->stack, progress->scope, progress->scopes, firstLine, progress->position, stopAt))
+		{
+			BytesParsed.fetch_add(progress->position - from, std::memory_order_relaxed);
+			return stack_ptr();
+		}
+
+		BytesParsed.fetch_add((last - first) - from, std::memory_order_relaxed);
+		stack_ptr res = progress->stack;
+		res->scope = progress->scopes.update(progress->line_scope, map);
+		progress.reset();
 		return res;
 	}
 }
@@ -10,8 +10,23 @@ namespace parse
 	typedef std::shared_ptr<stack_t> stack_ptr;
 
 	stack_ptr parse (char const* first, char const* last, stack_ptr stack, std::map<size_t, scope::scope_t>& scopes, bool firstLine);
+
+	// Long lines can be parsed in steps: each call stops at the first context change after parsing another byteLimit bytes and returns nullptr, with the position reached saved in progress. Call again with the same line and progress to continue. Once the end of the line is reached the stack is returned, scopes covers the entire line, and progress is reset.
+	struct line_progress_t;
+	typedef std::shared_ptr<line_progress_t> line_progress_ptr;
+	stack_ptr parse (char const* first, char const* last, stack_ptr stack, std::map<size_t, scope::scope_t>& scopes, bool firstLine, size_t byteLimit, line_progress_ptr& progress);
 	bool equal (stack_ptr lhs, stack_ptr rhs);
 
+	// Counters accumulated by all parsers since launch
+	struct statistics_t
+	{
+		size_t bytes_parsed;
+		size_t regexp_searches;
+		size_t regexp_searches_skipped;
+	};
+
+	statistics_t statistics ();
+
 } /* parse */
 
 #endif /* end of include guard: GRAMMAR_TYPES_H_4M8CRK03 */
@@ -4,6 +4,7 @@
 #include "parse.h"
 #include <scope/scope.h>
 #include <regexp/regexp.h>
+#include <mutex>
 
 namespace parse
 {
@@ -14,9 +15,27 @@ namespace parse
 	typedef std::map<std::string, rule_ptr> repository_t;
 	typedef std::shared_ptr<repository_t> repository_ptr;
 
+	// The rules which can match in a context, in the order used to rank matches. This depends only on the rule of the context, its scope, and which rules on the stack supply injections, so it is cached on the rule and shared by all lines and documents.
+	struct scanner_t
+	{
+		struct key_t
+		{
+			scope::scope_t scope;
+			std::vector<rule_t const*> injectors;
+
+			bool operator< (key_t const& rhs) const { return scope < rhs.scope || scope == rhs.scope && injectors < rhs.injectors; }
+		};
+
+		std::vector<rule_t*> injected_rules_pre;
+		std::vector<rule_t*> rules;
+		std::vector<rule_t*> injected_rules_post;
+	};
+
+	typedef std::shared_ptr<scanner_t> scanner_ptr;
+
 	struct rule_t
 	{
-		static size_t rule_id_counter;
+		static std::atomic_size_t rule_id_counter;
 
 		rule_t () : rule_id(++rule_id_counter), include_string(NULL_STR), scope_string(NULL_STR), content_scope_string(NULL_STR), match_string(NULL_STR), while_string(NULL_STR), end_string(NULL_STR), apply_end_last(NULL_STR) { }
 
@@ -51,17 +70,22 @@ namespace parse
 
 		rule_t* include = nullptr;
 
+		// Patterns are compiled the first time the rule is collected for a scanner, as most rules of a grammar are never used by a given document. Safe to call concurrently.
+		void compile_patterns ();
+		std::once_flag patterns_compiled;
+
 		regexp::pattern_t match_pattern;
 		regexp::pattern_t while_pattern;
 		regexp::pattern_t end_pattern;
 		bool match_pattern_is_anchored = false;
+		int match_pattern_first_byte = -1; // if the pattern can only match text starting with this byte we skip the regexp search when the byte is absent
+		bool is_root = false;
 
-		// =================
-		// = Mutable State =
-		// =================
+		// ================
+		// = Parser Cache =
+		// ================
 
-		bool included = false;
-		bool is_root = false;
+		std::map<scanner_t::key_t, scanner_ptr> scanners;
 	};
 
 	struct stack_t
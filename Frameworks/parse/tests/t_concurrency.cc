@@ -0,0 +1,84 @@
+#include "support.h"
+#include <test/bundle_index.h>
+#include <oak/duration.h>
+
+static bundles::item_ptr ConcurrencyTestGrammarItem;
+
+void setup_fixtures ()
+{
+	static std::string ConcurrencyTestLanguageGrammar =
+		"{ name           = 'Test';"
+		"  patterns       = ("
+		"    { include = '#comment'; },"
+		"    { include = '#string'; },"
+		"    { name = 'keyword'; match = '\\b(if|else|while|return)\\b'; },"
+		"    { name = 'number'; match = '\\b\\d+\\b'; },"
+		"    { begin = '\\{'; end = '\\}'; name = 'block';"
+		"      patterns = ( { include = '$self'; } );"
+		"    },"
+		"  );"
+		"  repository = {"
+		"    comment = { begin = '/\\*'; end = '\\*/'; name = 'comment'; };"
+		"    string  = { begin = '\"'; end = '\"'; name = 'string';"
+		"      patterns = ( { name = 'escape'; match = '\\\\.'; } );"
+		"    };"
+		"  };"
+		"  scopeName      = 'test';"
+		"  uuid           = '2F9B6A3C-7B0E-4D4B-9C5D-5B3E0E7C1A61';"
+		"}";
+
+	test::bundle_index_t bundleIndex;
+	ConcurrencyTestGrammarItem = bundleIndex.add(bundles::kItemTypeGrammar, ConcurrencyTestLanguageGrammar);
+}
+
+static std::string create_document (size_t lines)
+{
+	std::string res;
+	for(size_t i = 0; i < lines; ++i)
+	{
+		switch(i % 4)
+		{
+			case 0: res += "if (x == 42) { return \"a \\\"quoted\\\" string\"; }\n"; break;
+			case 1: res += "/* a comment that\n";                                  break;
+			case 2: res += "   spans two lines */ while (1) { x = 7; }\n";          break;
+			case 3: res += "{ nested { else 123 } }\n";                             break;
+		}
+	}
+	return res;
+}
+
+void test_concurrent_parsing ()
+{
+	auto grammar = parse::parse_grammar(ConcurrencyTestGrammarItem);
+	std::string const document = create_document(400);
+	std::string const expected = markup(grammar, document);
+
+	std::vector<std::string> actual(32);
+	std::string* results = actual.data();
+	dispatch_apply(actual.size(), DISPATCH_APPLY_AUTO, ^(size_t i){
+		results[i] = markup(grammar, document);
+	});
+
+	for(auto const& str : actual)
+		OAK_ASSERT_EQ(str, expected);
+}
+
+void benchmark_concurrent_parsing ()
+{
+	auto grammar = parse::parse_grammar(ConcurrencyTestGrammarItem);
+	std::string const document = create_document(20000);
+	size_t const documents = std::thread::hardware_concurrency();
+
+	oak::duration_t timer;
+	for(size_t i = 0; i < documents; ++i)
+		markup(grammar, document);
+	double serial = timer.duration();
+
+	timer.reset();
+	dispatch_apply(documents, DISPATCH_APPLY_AUTO, ^(size_t i){
+		markup(grammar, document);
+	});
+	double concurrent = timer.duration();
+
+	fprintf(stdout, "parsed %zu documents in %.2fs serially, %.2fs concurrently (%.1f× speedup)\n", documents, serial, concurrent, serial / concurrent);
+}
@@ -0,0 +1,106 @@
+#include "support.h"
+#include <test/bundle_index.h>
+
+static std::string grammar_plist (std::string const& numberScope)
+{
+	return
+		"{ name           = 'Test';"
+		"  patterns       = ("
+		"    { include = '#string'; },"
+		"    { name = '" + numberScope + "'; match = '\\d+'; },"
+		"  );"
+		"  repository     = {"
+		"    string = { name = 'string'; begin = '\"'; end = '\"';"
+		"      captures = { 0 = { name = 'punctuation'; }; };"
+		"      patterns = ( { name = 'escape'; match = '\\\\.'; } );"
+		"    };"
+		"  };"
+		"  scopeName      = 'test';"
+		"}";
+}
+
+void test_grammar_cache ()
+{
+	char dir[] = "/tmp/grammar_cache.XXXXXX";
+	OAK_ASSERT(mkdtemp(dir));
+	std::string const grammarPath = std::string(dir) + "/Test.tmLanguage";
+	std::string const cachePath   = std::string(dir) + "/Grammars";
+
+	if(FILE* fp = fopen(grammarPath.c_str(), "w"))
+	{
+		fputs(grammar_plist("number").c_str(), fp);
+		fclose(fp);
+	}
+
+	test::bundle_index_t bundleIndex;
+	bundles::item_ptr item = bundleIndex.add(bundles::kItemTypeGrammar, grammar_plist("number"));
+	item->add_path(grammarPath);
+	bundleIndex.commit();
+
+	parse::set_grammar_cache_path(cachePath);
+	std::string const cacheFile = cachePath + "/" + to_s(item->uuid()) + ".binary";
+	std::string const text = "12 \"a\\\"b\"\n";
+
+	OAK_ASSERT_EQ(markup(parse::parse_grammar(item), text), "«test»«number»12«/number» «string»«punctuation»\"«/punctuation»a«escape»\\\"«/escape»b«punctuation»\"«/punctuation»«/string»\n«/test»");
+	OAK_ASSERT_EQ(access(cacheFile.c_str(), R_OK), 0);
+
+	// Changes that are not saved to disk go unnoticed while the cache is valid, so this tells us that the cache was used
+	item->set_plist(boost::get<plist::dictionary_t>(plist::parse_ascii(grammar_plist("digits"))));
+	OAK_ASSERT_EQ(markup(parse::parse_grammar(item), text), "«test»«number»12«/number» «string»«punctuation»\"«/punctuation»a«escape»\\\"«/escape»b«punctuation»\"«/punctuation»«/string»\n«/test»");
+
+	struct timeval times[2] = { { time(nullptr) + 60, 0 }, { time(nullptr) + 60, 0 } };
+	utimes(grammarPath.c_str(), times);
+	OAK_ASSERT_EQ(markup(parse::parse_grammar(item), text), "«test»«digits»12«/digits» «string»«punctuation»\"«/punctuation»a«escape»\\\"«/escape»b«punctuation»\"«/punctuation»«/string»\n«/test»");
+
+	parse::set_grammar_cache_path(NULL_STR);
+	unlink(cacheFile.c_str());
+	unlink(grammarPath.c_str());
+	rmdir(cachePath.c_str());
+	rmdir(dir);
+}
+
+void test_grammar_cache_same_modification_date ()
+{
+	char dir[] = "/tmp/grammar_cache.XXXXXX";
+	OAK_ASSERT(mkdtemp(dir));
+	std::string const grammarPath = std::string(dir) + "/Test.tmLanguage";
+	std::string const cachePath   = std::string(dir) + "/Grammars";
+
+	if(FILE* fp = fopen(grammarPath.c_str(), "w"))
+	{
+		fputs(grammar_plist("number").c_str(), fp);
+		fclose(fp);
+	}
+
+	test::bundle_index_t bundleIndex;
+	bundles::item_ptr item = bundleIndex.add(bundles::kItemTypeGrammar, grammar_plist("number"));
+	item->add_path(grammarPath);
+	bundleIndex.commit();
+
+	parse::set_grammar_cache_path(cachePath);
+	std::string const cacheFile = cachePath + "/" + to_s(item->uuid()) + ".binary";
+	std::string const text = "12\n";
+
+	OAK_ASSERT_EQ(markup(parse::parse_grammar(item), text), "«test»«number»12«/number»\n«/test»");
+	OAK_ASSERT_EQ(access(cacheFile.c_str(), R_OK), 0);
+
+	// Rewrite the grammar but keep its modification date, the changed size must still invalidate the cache
+	struct stat buf;
+	OAK_ASSERT_EQ(stat(grammarPath.c_str(), &buf), 0);
+	if(FILE* fp = fopen(grammarPath.c_str(), "w"))
+	{
+		fputs(grammar_plist("digit").c_str(), fp);
+		fclose(fp);
+	}
+	struct timespec times[2] = { buf.st_atimespec, buf.st_mtimespec };
+	OAK_ASSERT_EQ(utimensat(AT_FDCWD, grammarPath.c_str(), times, 0), 0);
+
+	item->set_plist(boost::get<plist::dictionary_t>(plist::parse_ascii(grammar_plist("digit"))));
+	OAK_ASSERT_EQ(markup(parse::parse_grammar(item), text), "«test»«digit»12«/digit»\n«/test»");
+
+	parse::set_grammar_cache_path(NULL_STR);
+	unlink(cacheFile.c_str());
+	unlink(grammarPath.c_str());
+	rmdir(cachePath.c_str());
+	rmdir(dir);
+}
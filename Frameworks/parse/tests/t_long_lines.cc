@@ -0,0 +1,107 @@
+#include "support.h"
+#include <test/bundle_index.h>
+
+static bundles::item_ptr LongLineTestGrammarItem;
+static bundles::item_ptr MatchOnlyTestGrammarItem;
+
+void setup_fixtures ()
+{
+	static std::string TestLanguageGrammar =
+		"{ name           = 'Test';"
+		"  patterns       = ("
+		"    { name = 'string'; begin = '\"'; end = '\"';"
+		"      patterns = ( { name = 'escape'; match = '\\\\.'; } );"
+		"    },"
+		"    { name = 'number'; match = '\\d+'; },"
+		"    { name = 'eol'; match = '\\w+$'; },"
+		"  );"
+		"  scopeName      = 'test';"
+		"  uuid           = '0E8B4D2A-6C1F-4F7E-9A35-B2D1C8E4F601';"
+		"}";
+
+	static std::string MatchOnlyLanguageGrammar =
+		"{ name           = 'Match Only';"
+		"  patterns       = ("
+		"    { name = 'number'; match = '\\d+'; },"
+		"    { name = 'word'; match = '[a-z]+'; },"
+		"  );"
+		"  scopeName      = 'match-only';"
+		"  uuid           = '5C1D7A3E-2B9F-4E60-8D14-A7F3E9B2C5D8';"
+		"}";
+
+	test::bundle_index_t bundleIndex;
+	LongLineTestGrammarItem  = bundleIndex.add(bundles::kItemTypeGrammar, TestLanguageGrammar);
+	MatchOnlyTestGrammarItem = bundleIndex.add(bundles::kItemTypeGrammar, MatchOnlyLanguageGrammar);
+}
+
+static std::string long_line (size_t repeat)
+{
+	std::string res;
+	for(size_t i = 0; i < repeat; ++i)
+		res += "\"a\\\"b\" 12, ";
+	return res + "end\n";
+}
+
+void test_long_line ()
+{
+	auto grammar = parse::parse_grammar(LongLineTestGrammarItem);
+
+	std::string expected = "«test»";
+	for(size_t i = 0; i < 2000; ++i)
+		expected += "«string»\"a«escape»\\\"«/escape»b\"«/string» «number»12«/number», ";
+	expected += "«eol»end«/eol»\n«/test»";
+
+	OAK_ASSERT_EQ(markup(grammar, long_line(2000)), expected);
+}
+
+void test_parse_in_steps ()
+{
+	auto grammar = parse::parse_grammar(LongLineTestGrammarItem);
+	std::string const line = long_line(2000);
+
+	std::map<size_t, scope::scope_t> expected;
+	parse::stack_ptr expectedState = parse::parse(line.data(), line.data() + line.size(), grammar->seed(), expected, true);
+
+	std::map<size_t, scope::scope_t> scopes;
+	parse::line_progress_ptr progress;
+	parse::stack_ptr state;
+
+	size_t steps = 0;
+	for(; !state; ++steps)
+	{
+		state = parse::parse(line.data(), line.data() + line.size(), grammar->seed(), scopes, true, 1024, progress);
+		OAK_ASSERT(state || progress);
+	}
+
+	OAK_ASSERT_GT(steps, 10);
+	OAK_ASSERT(!progress);
+	OAK_ASSERT(parse::equal(state, expectedState));
+	OAK_ASSERT(scopes == expected);
+}
+
+void test_parse_match_rules_in_steps ()
+{
+	auto grammar = parse::parse_grammar(MatchOnlyTestGrammarItem);
+	std::string line;
+	for(size_t i = 0; i < 2000; ++i)
+		line += "12 ab, ";
+	line += "\n";
+
+	std::map<size_t, scope::scope_t> expected;
+	parse::stack_ptr expectedState = parse::parse(line.data(), line.data() + line.size(), grammar->seed(), expected, true);
+
+	std::map<size_t, scope::scope_t> scopes;
+	parse::line_progress_ptr progress;
+	parse::stack_ptr state;
+
+	size_t steps = 0;
+	for(; !state; ++steps)
+	{
+		state = parse::parse(line.data(), line.data() + line.size(), grammar->seed(), scopes, true, 1024, progress);
+		OAK_ASSERT(state || progress);
+	}
+
+	OAK_ASSERT_GT(steps, 10);
+	OAK_ASSERT(parse::equal(state, expectedState));
+	OAK_ASSERT(scopes == expected);
+}
@@ -0,0 +1,40 @@
+#include "support.h"
+#include <test/bundle_index.h>
+
+static bundles::item_ptr FirstByteTestGrammarItem;
+
+void setup_fixtures ()
+{
+	static std::string FirstByteLanguageGrammar =
+		"{ name           = 'First Byte';"
+		"  patterns       = ("
+		"    { name = 'tag'; match = '#\\w+'; },"
+		"    { name = 'mention'; match = '@\\w+'; },"
+		"    { name = 'number'; match = '\\d+'; },"
+		"  );"
+		"  scopeName      = 'first-byte';"
+		"  uuid           = '8F2A6C1D-4B3E-4D57-9E80-C6A1B5D2F3E4';"
+		"}";
+
+	test::bundle_index_t bundleIndex;
+	FirstByteTestGrammarItem = bundleIndex.add(bundles::kItemTypeGrammar, FirstByteLanguageGrammar);
+}
+
+void test_absent_first_byte_skips_search ()
+{
+	auto grammar = parse::parse_grammar(FirstByteTestGrammarItem);
+
+	parse::statistics_t const before = parse::statistics();
+	OAK_ASSERT_EQ(markup(grammar, "abc 123 def\n"), "«first-byte»abc «number»123«/number» def\n«/first-byte»");
+	parse::statistics_t const after = parse::statistics();
+
+	// Neither ‘#’ nor ‘@’ is on the line so only the number rule needs Onigmo
+	OAK_ASSERT_GE(after.regexp_searches_skipped - before.regexp_searches_skipped, 2);
+	OAK_ASSERT_GT(after.regexp_searches, before.regexp_searches);
+}
+
+void test_present_first_byte_is_searched ()
+{
+	auto grammar = parse::parse_grammar(FirstByteTestGrammarItem);
+	OAK_ASSERT_EQ(markup(grammar, "a #b 1 @c\n"), "«first-byte»a «tag»#b«/tag» «number»1«/number» «mention»@c«/mention»\n«/first-byte»");
+}
@@ -3,6 +3,11 @@
 #include <Onigmo/oniguruma.h>
 #include <text/utf8.h>
 #include <cf/cf.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace find
 {
@@ -42,6 +47,7 @@ namespace find
 		find_implementation_t () : skip_first(0), skip_last(0)  { }
 		virtual ~find_implementation_t ()                       { }
 		virtual std::pair<ssize_t, ssize_t> match (char const* buf, ssize_t len, std::map<std::string, std::string>* captures) = 0;
+		virtual bool pop_match (std::pair<size_t, size_t>& range, std::map<std::string, std::string>& captures) { return false; } // matches found by the preceding call to match(), relative to the first byte searched
 
 		ssize_t skip_first, skip_last;
 	};
@@ -165,24 +171,29 @@ namespace find
 		return ch < 0x80 ? isspace(ch) : CFCharacterSetIsLongCharacterMember(whitespace_set, ch);
 	}
 
-	struct regular_find_t : find_implementation_t
+	// One row per character of the search string, each row holding all byte sequences that the character can match
+	static std::vector< std::vector<std::string> > variations_matrix (std::string const& str, options_t options)
 	{
-		regular_find_t (std::string const& str, options_t options) : options(options)
+		std::vector< std::vector<std::string> > matrix;
+		citerate(it, diacritics::make_range(str.data(), str.data() + str.size()))
 		{
-			std::vector< std::vector<std::string> > matrix;
-			citerate(it, diacritics::make_range(str.data(), str.data() + str.size()))
-			{
-				if((options & ignore_whitespace) && is_whitespace(*it))
-					continue;
+			if((options & ignore_whitespace) && is_whitespace(*it))
+				continue;
 
-				if(CFStringRef tmp = CFStringCreateWithBytes(kCFAllocatorDefault, (UInt8*)&it, it.length(), kCFStringEncodingUTF8, false))
-				{
-					matrix.push_back(std::vector<std::string>());
-					all_variations(tmp, options, matrix.back());
-					CFRelease(tmp);
-				}
+			if(CFStringRef tmp = CFStringCreateWithBytes(kCFAllocatorDefault, (UInt8*)&it, it.length(), kCFStringEncodingUTF8, false))
+			{
+				matrix.push_back(std::vector<std::string>());
+				all_variations(tmp, options, matrix.back());
+				CFRelease(tmp);
 			}
+		}
+		return matrix;
+	}
 
+	struct regular_find_t : find_implementation_t
+	{
+		regular_find_t (std::vector< std::vector<std::string> > matrix, options_t options) : options(options)
+		{
 			if(options & backwards)
 			{
 				std::reverse(matrix.begin(), matrix.end());
@@ -307,32 +318,446 @@ namespace find
 		}
 	};
 
+	// ==========================
+	// = Literal text searching =
+	// ==========================
+
+	static bool is_ascii_letter (char ch) { return 'a' <= (ch | 0x20) && (ch | 0x20) <= 'z'; }
+	static bool is_ascii_space (char ch)  { return ch == ' ' || ('\t' <= ch && ch <= '\r'); }
+	static char to_lower (char ch)        { return 'A' <= ch && ch <= 'Z' ? ch | 0x20 : ch; }
+
+	// Succeeds when each character of the search string has exactly one byte sequence, or (when ignoring case) is an ASCII letter, in which case the lowercase letter is used
+	static bool literal_needle (std::vector< std::vector<std::string> > const& matrix, options_t options, std::string& needle)
+	{
+		for(auto const& row : matrix)
+		{
+			if(row.size() == 1 && (!(options & ignore_case) || std::none_of(row[0].begin(), row[0].end(), &is_ascii_letter)))
+				needle += row[0];
+			else if(row.size() == 2 && (options & ignore_case) && row[0].size() == 1 && row[1].size() == 1 && is_ascii_letter(row[0][0]) && to_lower(row[0][0]) == to_lower(row[1][0]))
+				needle += to_lower(row[0][0]);
+			else
+				return false;
+		}
+		return !needle.empty();
+	}
+
+	// Candidates are found by testing the first and last byte of the needle against 16 (SSE2) or 32 (AVX2) positions at a time, only candidates are verified byte by byte. When ignoring whitespace the distance between first and last byte is not fixed, so only the first byte is tested.
+	// A candidate that is still matching at the end of a chunk is kept in _pending and resumed with the next chunk, so matches spanning chunks are found (with a negative start offset) just like with regular_find_t.
+
+	struct literal_find_t : find_implementation_t
+	{
+		literal_find_t (std::string const& needle, options_t options) : _needle(needle), _fold(options & ignore_case), _ignore_whitespace(options & ignore_whitespace)
+		{
+			_span       = _ignore_whitespace ? 1 : _needle.size();
+			_first      = _needle.front();
+			_last       = _needle[_span-1];
+			_first_mask = _fold && is_ascii_letter(_first) ? 0x20 : 0;
+			_last_mask  = _fold && is_ascii_letter(_last)  ? 0x20 : 0;
+		}
+
+		std::pair<ssize_t, ssize_t> match (char const* buf, ssize_t len, std::map<std::string, std::string>* captures)
+		{
+			size_t matchLen;
+			if(!buf) // end-of-buffer, pending candidate can no longer match
+			{
+				_pending.clear();
+				return { len+1, len };
+			}
+
+			if(!_pending.empty())
+			{
+				std::string pending;
+				pending.swap(_pending);
+
+				ssize_t const pendingLen = pending.size();
+				for(size_t i = next_candidate(pending.data(), 0, pending.size()); i < pending.size(); i = next_candidate(pending.data(), i+1, pending.size()))
+				{
+					switch(verify(pending.data() + i, pending.size() - i, buf, len, matchLen))
+					{
+						case kMatch:    return { (ssize_t)i - pendingLen, (ssize_t)(i + matchLen) - pendingLen };
+						case kPartial:  _pending = pending.substr(i).append(buf, len); return { len+1, len };
+						case kMismatch: break;
+					}
+				}
+			}
+
+			for(size_t i = next_candidate(buf, 0, len); i < (size_t)len; i = next_candidate(buf, i+1, len))
+			{
+				switch(verify(buf + i, len - i, nullptr, 0, matchLen))
+				{
+					case kMatch:    return { (ssize_t)i, (ssize_t)(i + matchLen) };
+					case kPartial:  _pending.assign(buf + i, buf + len); return { len+1, len };
+					case kMismatch: break;
+				}
+			}
+			return { len+1, len };
+		}
+
+		// Returns the first complete match in [first, last) without touching the state used by match()
+		char const* find (char const* first, char const* last) const
+		{
+			size_t matchLen, len = last - first;
+			for(size_t i = next_candidate(first, 0, len); i < len; i = next_candidate(first, i+1, len))
+			{
+				if(verify(first + i, len - i, nullptr, 0, matchLen) == kMatch)
+					return first + i;
+			}
+			return nullptr;
+		}
+
+	private:
+		enum verdict_t { kMismatch, kPartial, kMatch };
+
+		// Compare needle against the concatenation of first and second, on success matchLen is set to the number of bytes matched (including skipped whitespace)
+		verdict_t verify (char const* first, size_t firstLen, char const* second, size_t secondLen, size_t& matchLen) const
+		{
+			size_t i = 0;
+			for(size_t j = 0; j < _needle.size(); ++i)
+			{
+				if(i == firstLen + secondLen)
+					return kPartial;
+
+				char const ch = i < firstLen ? first[i] : second[i - firstLen];
+				if(_ignore_whitespace && j != 0 && is_ascii_space(ch))
+					continue;
+				if((_fold ? to_lower(ch) : ch) != _needle[j++])
+					return kMismatch;
+			}
+			matchLen = i;
+			return kMatch;
+		}
+
+		// Return first index ≥ from where both first and last byte of the needle match, or where the first byte matches and the last byte is beyond len
+		size_t next_candidate (char const* buf, size_t i, size_t len) const
+		{
+#if defined(__AVX2__)
+			__m256i const first256 = _mm256_set1_epi8(_first), firstMask256 = _mm256_set1_epi8(_first_mask);
+			__m256i const last256  = _mm256_set1_epi8(_last),  lastMask256  = _mm256_set1_epi8(_last_mask);
+			for(; i + _span + 31 <= len; i += 32)
+			{
+				__m256i const blockFirst = _mm256_loadu_si256((__m256i const*)(buf + i));
+				__m256i const blockLast  = _mm256_loadu_si256((__m256i const*)(buf + i + _span - 1));
+				__m256i const eq = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(blockFirst, firstMask256), first256), _mm256_cmpeq_epi8(_mm256_or_si256(blockLast, lastMask256), last256));
+				if(uint32_t mask = _mm256_movemask_epi8(eq))
+					return i + __builtin_ctz(mask);
+			}
+#endif
+#if defined(__SSE2__)
+			__m128i const first128 = _mm_set1_epi8(_first), firstMask128 = _mm_set1_epi8(_first_mask);
+			__m128i const last128  = _mm_set1_epi8(_last),  lastMask128  = _mm_set1_epi8(_last_mask);
+			for(; i + _span + 15 <= len; i += 16)
+			{
+				__m128i const blockFirst = _mm_loadu_si128((__m128i const*)(buf + i));
+				__m128i const blockLast  = _mm_loadu_si128((__m128i const*)(buf + i + _span - 1));
+				__m128i const eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(blockFirst, firstMask128), first128), _mm_cmpeq_epi8(_mm_or_si128(blockLast, lastMask128), last128));
+				if(uint32_t mask = _mm_movemask_epi8(eq))
+					return i + __builtin_ctz(mask);
+			}
+#endif
+			while(i < len)
+			{
+				if(_first_mask == 0)
+				{
+					char const* p = (char const*)memchr(buf + i, _first, len - i);
+					if(!p)
+						return len;
+					i = p - buf;
+				}
+				else if((char)(buf[i] | _first_mask) != _first)
+				{
+					++i;
+					continue;
+				}
+
+				if(i + _span > len || (char)(buf[i + _span - 1] | _last_mask) == _last)
+					return i;
+				++i;
+			}
+			return len;
+		}
+
+		std::string _needle;
+		bool _fold, _ignore_whitespace;
+		size_t _span;
+		char _first, _last, _first_mask, _last_mask;
+		std::string _pending;
+	};
+
+	// ===========================
+	// = Required literal filter =
+	// ===========================
+
+	// Onigmo folds some ASCII letters to non-ASCII characters or ligatures (k → K, s → ſ, fi → ﬁ, ss → ß, etc.) so when ignoring case we leave those out of the literal
+	static bool is_literal_char (char ch, bool ignoreCase)
+	{
+		return 0x20 <= ch && ch < 0x7F && (!ignoreCase || !strchr("fiklstFIKLST", ch));
+	}
+
+	// Returns the index after the escape at ‘i’ including its arguments, e.g. \x41, \x{263A}, \u263A, \101, \cX, \C-x, \M-\C-x, \k<name>, \g'name' or \p{Alpha}, and npos when it is unterminated
+	static size_t skip_escape (std::string const& pattern, size_t i)
+	{
+		if(++i == pattern.size())
+			return std::string::npos;
+
+		auto skip_digits = [&pattern](size_t i, size_t max, bool hex) {
+			for(; max && i < pattern.size() && (hex ? isxdigit(pattern[i]) : isdigit(pattern[i])); --max)
+				++i;
+			return i;
+		};
+
+		auto skip_to = [&pattern](size_t i, char close) {
+			size_t const last = pattern.find(close, i + 1);
+			return last == std::string::npos ? last : last + 1;
+		};
+
+		char const ch = pattern[i++];
+		if(i < pattern.size() && pattern[i] == '{' && strchr("xupPo", ch))
+			return skip_to(i, '}');
+		else if(ch == 'x')
+			return skip_digits(i, 2, true);
+		else if(ch == 'u')
+			return skip_digits(i, 4, true);
+		else if(isdigit(ch)) // back reference or octal escape
+			return skip_digits(i, std::string::npos, false);
+		else if((ch == 'k' || ch == 'g') && i < pattern.size() && (pattern[i] == '<' || pattern[i] == '\''))
+			return skip_to(i, pattern[i] == '<' ? '>' : '\'');
+
+		if((ch == 'C' || ch == 'M') && i < pattern.size() && pattern[i] == '-')
+			++i;
+		else if(ch != 'c')
+			return i;
+
+		if(i == pattern.size())
+			return std::string::npos;
+		return pattern[i] == '\\' ? skip_escape(pattern, i) : i + 1; // control or meta character, e.g. \cX or \M-\C-x
+	}
+
+	static size_t skip_group (std::string const& pattern, size_t i, char open, char close)
+	{
+		for(size_t depth = 0; i < pattern.size(); ++i)
+		{
+			if(pattern[i] == '\\')
+			{
+				++i;
+			}
+			else if(pattern[i] == open)
+			{
+				++depth;
+				if(open == '[') // a ‘]’ first in a class is a literal, e.g. []abc] or [^]abc]
+				{
+					if(i+1 < pattern.size() && pattern[i+1] == '^')
+						++i;
+					if(i+1 < pattern.size() && pattern[i+1] == ']')
+						++i;
+				}
+			}
+			else if(pattern[i] == '[' && open == '(') // a class can contain parentheses, e.g. ([)])
+			{
+				i = skip_group(pattern, i, '[', ']');
+				if(i == std::string::npos)
+					break;
+				--i;
+			}
+			else if(pattern[i] == close && --depth == 0)
+			{
+				return i+1;
+			}
+		}
+		return std::string::npos;
+	}
+
+	// Returns the longest run of characters that all matches must contain, or the empty string when we cannot tell. Groups, classes and escapes other than escaped punctuation (including arguments like the digits of \x41) are treated as unknown atoms, and a top-level alternation or inline options give up.
+	static std::string required_literal (std::string const& pattern, bool ignoreCase)
+	{
+		std::string res, run;
+		auto flush = [&](){
+			if(run.size() > res.size())
+				res = run;
+			run.clear();
+		};
+
+		for(size_t i = 0; i < pattern.size(); )
+		{
+			std::string atom;
+			switch(char ch = pattern[i])
+			{
+				case '|':
+				case ')':
+				case '*':
+				case '+':
+				case '?':
+				case '{':
+					return "";
+
+				case '(':
+				{
+					if(pattern.compare(i, 2, "(?") == 0 && i+2 < pattern.size() && strchr("imx-", pattern[i+2]))
+						return "";
+					i = skip_group(pattern, i, '(', ')');
+				}
+				break;
+
+				case '[':
+				{
+					i = skip_group(pattern, i, '[', ']');
+				}
+				break;
+
+				case '\\':
+				{
+					if(i+1 == pattern.size())
+						return "";
+					if(!isalnum(pattern[i+1]) && is_literal_char(pattern[i+1], ignoreCase))
+						atom = pattern[i+1];
+					i = skip_escape(pattern, i);
+				}
+				break;
+
+				default:
+				{
+					if(is_literal_char(ch, ignoreCase) && ch != '.' && ch != '^' && ch != '$')
+						atom = ignoreCase ? to_lower(ch) : ch;
+					i += (ch & 0x80) ? std::max<size_t>(utf8::multibyte<char>::length(ch), 1) : 1;
+				}
+				break;
+			}
+
+			if(i == std::string::npos || i > pattern.size())
+				return "";
+
+			if(i < pattern.size() && strchr("?*+{", pattern[i]))
+			{
+				size_t min = 1;
+				if(pattern[i] == '{')
+				{
+					size_t const last = pattern.find('}', i);
+					if(last == std::string::npos || !isdigit(pattern[i+1]))
+						return "";
+					min = strtol(pattern.c_str() + i + 1, nullptr, 10);
+					i = last;
+				}
+				else if(pattern[i] != '+')
+				{
+					min = 0;
+				}
+
+				if(++i < pattern.size() && (pattern[i] == '?' || pattern[i] == '+')) // lazy or possessive
+					++i;
+
+				if(min != 0)
+					run += atom;
+				flush();
+			}
+			else if(atom.empty())
+			{
+				flush();
+			}
+			else
+			{
+				run += atom;
+			}
+		}
+		flush();
+		return res;
+	}
+
+	// Conservative: only escapes for word characters, digits, hex digits and anchors are known to not match a newline
+	static bool can_match_newline (std::string const& pattern)
+	{
+		if(pattern.find_first_of("\n\r") != std::string::npos || pattern.find("[^") != std::string::npos || pattern.find("[:") != std::string::npos)
+			return true;
+
+		for(size_t i = 0; i+1 < pattern.size(); ++i)
+		{
+			if(pattern[i] == '\\' && isalnum(pattern[++i]) && !strchr("wdhbBAzZ", pattern[i]))
+				return true;
+		}
+		return false;
+	}
+
+	// When a regular expression has a required literal we use the literal searcher to find candidates, and for patterns that cannot match a newline we only let Onigmo search the lines containing the literal.
+
+	struct literal_prefilter_t
+	{
+		literal_prefilter_t (std::string const& pattern, options_t options)
+		{
+			std::string const literal = required_literal(pattern, options & ignore_case);
+			if(!literal.empty() && !(options & backwards) && pattern.find("\\G") == std::string::npos) // \G anchors to where we start searching
+			{
+				_literal = std::make_unique<literal_find_t>(literal, options & ignore_case);
+				_single_line = !can_match_newline(pattern);
+			}
+		}
+
+		int search (OnigRegex pattern, OnigUChar const* first, OnigUChar const* last, OnigUChar const* start, OnigUChar const* range, OnigRegion* region, OnigOptionType flags) const
+		{
+			if(!_literal || range < start)
+				return onig_search(pattern, first, last, start, range, region, flags);
+
+			for(OnigUChar const* from = start; from <= range; )
+			{
+				OnigUChar const* candidate = (OnigUChar const*)_literal->find((char const*)from, (char const*)last);
+				if(!candidate)
+					break;
+				else if(!_single_line) // a match can start any distance before the literal, so the candidate only tells us that a match is possible and Onigmo must still search from ‘from’ (not the candidate)
+					return onig_search(pattern, first, last, from, range, region, flags);
+
+				OnigUChar const* bol = candidate;
+				while(bol != from && bol[-1] != '\n')
+					--bol;
+				OnigUChar const* eol = (OnigUChar const*)memchr(candidate, '\n', last - candidate);
+				if(!eol)
+					eol = last;
+
+				if(range < bol)
+					break;
+
+				int r = onig_search(pattern, first, last, bol, std::min(eol, range), region, flags);
+				if(r != ONIG_MISMATCH || eol == last)
+					return r;
+				from = eol + 1;
+			}
+			return ONIG_MISMATCH;
+		}
+
+	private:
+		std::unique_ptr<literal_find_t> _literal;
+		bool _single_line = false;
+	};
+
 	// ====================
 	// = Regexp searching =
 	// ====================
 
+	static OnigRegex compile_pattern (std::string const& str, options_t options)
+	{
+		OnigRegex res = nullptr;
+		OnigErrorInfo einfo;
+		int r = onig_new(&res, (OnigUChar const*)str.data(), (OnigUChar const*)str.data() + str.size(), (options & ignore_case ? ONIG_OPTION_IGNORECASE : 0) | ONIG_OPTION_CAPTURE_GROUP, ONIG_ENCODING_UTF8, ONIG_SYNTAX_DEFAULT, &einfo);
+		if(r != ONIG_NORMAL)
+		{
+			OnigUChar s[ONIG_MAX_ERROR_MESSAGE_LEN];
+			onig_error_code_to_str(s, r, &einfo);
+			os_log_error(OS_LOG_DEFAULT, "regexp_find_t: %{public}s (%{public}s)", s, str.c_str());
+
+			if(res)
+			{
+				onig_free(res);
+				res = nullptr;
+			}
+		}
+		return res;
+	}
+
 	struct regexp_find_t : find_implementation_t
 	{
-		regexp_find_t (std::string const& str, options_t options) : options(options)
+		regexp_find_t (std::string const& str, options_t options) : options(options), prefilter(str, options)
 		{
 			did_start_searching = false;
 			last_beg = -1;
 			last_end = 0;
 
-			OnigErrorInfo einfo;
-			int r = onig_new(&compiled_pattern, (OnigUChar const*)str.data(), (OnigUChar const*)str.data() + str.size(), (options & ignore_case ? ONIG_OPTION_IGNORECASE : 0) | ONIG_OPTION_CAPTURE_GROUP, ONIG_ENCODING_UTF8, ONIG_SYNTAX_DEFAULT, &einfo);
-			if(r != ONIG_NORMAL)
-			{
-				OnigUChar s[ONIG_MAX_ERROR_MESSAGE_LEN];
-				onig_error_code_to_str(s, r, &einfo);
-				os_log_error(OS_LOG_DEFAULT, "regexp_find_t: %{public}s (%{public}s)", s, str.c_str());
-
-				if(compiled_pattern)
-				{
-					onig_free(compiled_pattern);
-					compiled_pattern = nullptr;
-				}
-			}
+			compiled_pattern = compile_pattern(str, options);
 		}
 
 		~regexp_find_t ()
@@ -393,7 +818,7 @@ namespace find
 
 				int r;
 				OnigRegion* region = onig_region_new();
-				if(ONIG_MISMATCH != (r = onig_search(compiled_pattern, first, last, range_start, range_stop, region, flags)))
+				if(ONIG_MISMATCH != (r = prefilter.search(compiled_pattern, first, last, range_start, range_stop, region, flags)))
 				{
 					// fprintf(stderr, "match: %d-%d\n", region->beg[0], region->end[0]);
 					res = std::pair<ssize_t, ssize_t>(region->beg[0], region->end[0]);
@@ -404,8 +829,8 @@ namespace find
 						*captures = extract_captures(first, region, compiled_pattern);
 				}
 
-				last_beg = region->beg[0];
-				last_end = region->end[0];
+				last_beg = r >= 0 ? region->beg[0] : ONIG_REGION_NOTPOS;
+				last_end = r >= 0 ? region->end[0] : ONIG_REGION_NOTPOS;
 
 				onig_region_free(region, 1);
 			}
@@ -423,21 +848,174 @@ namespace find
 	private:
 		OnigRegex compiled_pattern;
 		options_t options;
+		literal_prefilter_t prefilter;
 		std::vector<char> buffer;
 		ssize_t buffer_size = 0;
 		int last_beg, last_end;
 		bool did_start_searching;
 	};
 
+	// =============================
+	// = Windowed regexp searching =
+	// =============================
+
+	// Data is collected until we have a full window, which is then searched for matches starting before the last overlap bytes. We keep the overlap (and a few bytes before it, for look-behind and anchors) as the start of the next window. If a match reaches the end of the window we double the window size and search again when it is full.
+
+	struct windowed_regexp_find_t : find_implementation_t
+	{
+		windowed_regexp_find_t (std::string const& str, options_t options, window_t const& window) : _options(options), _overlap(window.overlap), _prefilter(str, options)
+		{
+			_window_size = std::max(window.size, 2 * (window.overlap + kContextBytes));
+			_maximum_window_size = std::max(window.maximum_size, _window_size);
+			_compiled_pattern = compile_pattern(str, options);
+		}
+
+		~windowed_regexp_find_t ()
+		{
+			if(_compiled_pattern)
+				onig_free(_compiled_pattern);
+		}
+
+		std::pair<ssize_t, ssize_t> match (char const* buf, ssize_t len, std::map<std::string, std::string>* captures)
+		{
+			if(!_compiled_pattern)
+				return { len+1, len };
+
+			if(!buf) // end-of-buffer
+			{
+				if(!_did_search_last_window)
+				{
+					_did_search_last_window = true;
+					search(true);
+				}
+				return { len+1, len };
+			}
+
+			// Only consume what fits in the window, find_t::each_match will call us again with the remaining bytes
+			ssize_t const consumed = std::min<ssize_t>(len, _window_size - _window.size());
+			_window.insert(_window.end(), buf, buf + consumed);
+			if(_window.size() == _window_size)
+				search(false);
+			return { consumed+1, consumed };
+		}
+
+		bool pop_match (std::pair<size_t, size_t>& range, std::map<std::string, std::string>& captures)
+		{
+			if(_matches.empty())
+				return false;
+
+			range = _matches.front().first;
+			captures.swap(_matches.front().second);
+			_matches.pop_front();
+			return true;
+		}
+
+	private:
+		static constexpr size_t kContextBytes = 16;
+
+		// Searching from or trimming at a continuation byte would make Onigmo see a broken character
+		static bool is_continuation_byte (char ch) { return (ch & 0xC0) == 0x80; }
+
+		void search (bool atEOF)
+		{
+			size_t const windowEnd = _window_start + _window.size();
+			size_t limit = atEOF ? windowEnd : windowEnd - _overlap;
+			while(limit > _window_start && limit < windowEnd && is_continuation_byte(_window[limit - _window_start]))
+				--limit;
+
+			OnigUChar const* first = (OnigUChar const*)_window.data();
+			OnigUChar const* last  = first + _window.size();
+
+			OnigOptionType flags = ONIG_OPTION_NONE;
+			if(_options & find::not_bol)
+				flags |= ONIG_OPTION_NOTBOL;
+			if(!atEOF || (_options & find::not_eol))
+				flags |= ONIG_OPTION_NOTEOL;
+			if(_window_start != 0) // the window no longer starts at the beginning of the file, so \A must not match there
+				flags |= ONIG_OPTION_NOTBOS;
+			if(!atEOF) // the window does not end at the end of the file, so neither \z nor \Z must match there
+				flags |= ONIG_OPTION_NOTEOS;
+
+			OnigRegion* region = onig_region_new();
+			while(_search_from < limit || (atEOF && _search_from == limit)) // with start = range Onigmo does a backward search
+			{
+				if(_prefilter.search(_compiled_pattern, first, last, first + (_search_from - _window_start), first + (limit - _window_start), region, flags) < 0) // ONIG_MISMATCH or error
+					break;
+
+				size_t const from = _window_start + region->beg[0], to = _window_start + region->end[0];
+				if(from < _search_from || (!atEOF && from >= limit)) // the latter will be found again in next window
+					break;
+
+				if(!atEOF && to == windowEnd) // the match may continue after the window
+				{
+					if(_window_size < _maximum_window_size)
+					{
+						_window_size = std::min(2 * _window_size, _maximum_window_size);
+						onig_region_free(region, 1);
+						return; // keep the window and search it again when it is full
+					}
+
+					os_log_error(OS_LOG_DEFAULT, "windowed_regexp_find_t: match at %zu reaches the end of a %zu byte window so it may be incomplete, skipping it", from, _window_size);
+					_search_from = to;
+					continue;
+				}
+
+				_matches.emplace_back(std::make_pair(from, to), extract_captures(first, region, _compiled_pattern));
+				_search_from = to;
+				if(from == to) // zero-width match, so advance one character to not repeat it
+				{
+					if(to == windowEnd)
+						break;
+					char const ch = _window[to - _window_start];
+					_search_from += utf8::multibyte<char>::is_start(ch) ? std::min(utf8::multibyte<char>::length(ch), windowEnd - to) : 1;
+				}
+			}
+			onig_region_free(region, 1);
+
+			_search_from = std::max(_search_from, limit);
+			if(!atEOF)
+			{
+				size_t keepFrom = std::max(limit, _window_start + kContextBytes) - kContextBytes;
+				while(keepFrom > _window_start && is_continuation_byte(_window[keepFrom - _window_start]))
+					--keepFrom;
+
+				_window.erase(_window.begin(), _window.begin() + (keepFrom - _window_start));
+				_window_start = keepFrom;
+			}
+		}
+
+		OnigRegex _compiled_pattern;
+		options_t _options;
+		size_t _window_size, _maximum_window_size, _overlap;
+		literal_prefilter_t _prefilter;
+
+		std::vector<char> _window;
+		size_t _window_start = 0;
+		size_t _search_from = 0;
+		bool _did_search_last_window = false;
+		std::deque<std::pair<std::pair<size_t, size_t>, std::map<std::string, std::string>>> _matches;
+	};
+
 	// =================
 	// = Find_t facade =
 	// =================
 
-	find_t::find_t (std::string const& str, options_t options)
+	find_t::find_t (std::string const& str, options_t options, window_t const& window)
 	{
 		if(options & regular_expression)
-				pimpl = std::make_shared<regexp_find_t>(str, options);
-		else	pimpl = std::make_shared<regular_find_t>(str, options);
+		{
+			if((options & windowed) && !(options & backwards) && str.find("\\G") == std::string::npos)
+					pimpl = std::make_shared<windowed_regexp_find_t>(str, options, window);
+			else	pimpl = std::make_shared<regexp_find_t>(str, options);
+		}
+		else
+		{
+			std::string needle;
+			auto const matrix = variations_matrix(str, options);
+			if(!(options & backwards) && literal_needle(matrix, options, needle))
+					pimpl = std::make_shared<literal_find_t>(needle, options);
+			else	pimpl = std::make_shared<regular_find_t>(matrix, options);
+		}
 	}
 
 	void find_t::each_match (char const* buf, size_t len, bool moreToCome, std::function<void(std::pair<size_t, size_t> const&, std::map<std::string, std::string> const&)> const& f)
@@ -449,6 +1027,10 @@ namespace find
 			if(m.first <= m.second)
 				f(std::make_pair(_offset + offset + m.first, _offset + offset + m.second), captures);
 			offset += m.second;
+
+			std::pair<size_t, size_t> range;
+			for(captures.clear(); pimpl->pop_match(range, captures); captures.clear())
+				f(range, captures);
 		}
 
 		_offset += len;
@@ -463,6 +1045,10 @@ namespace find
 				captures.clear();
 				m = pimpl->match(nullptr, 0, &captures);
 			}
+
+			std::pair<size_t, size_t> range;
+			for(captures.clear(); pimpl->pop_match(range, captures); captures.clear())
+				f(range, captures);
 		}
 	}
 
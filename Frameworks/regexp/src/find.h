@@ -19,6 +19,7 @@ namespace find
 		all_matches        = (1 << 8),
 		extend_selection   = (1 << 9),
 		filesize_limit     = (1 << 10),
+		windowed           = (1 << 11),
 	};
 
 	options_t operator| (options_t lhs, options_t rhs);
@@ -29,9 +30,17 @@ namespace find
 
 	struct find_implementation_t;
 
+	// With the windowed option a regular expression is searched in a sliding window of (at least) size bytes, so memory use does not depend on the amount of data searched. The last overlap bytes of a window are searched again as part of the next window. A match reaching the end of a window (so it may continue in the data that follows) makes the window grow, up to maximum_size, beyond which such a match is logged and not reported. A match that only exists because of text more than overlap bytes past the window end (e.g. `(a+)y` after a long run of a) can still be missed or found shorter.
+	struct window_t
+	{
+		size_t size         = 4 * 1024 * 1024;
+		size_t overlap      = 64 * 1024;
+		size_t maximum_size = 64 * 1024 * 1024;
+	};
+
 	struct find_t
 	{
-		find_t (std::string const& str, options_t options = none);
+		find_t (std::string const& str, options_t options = none, window_t const& window = window_t());
 
 		void each_match (char const* buf, size_t len, bool moreToCome, std::function<void(std::pair<size_t, size_t> const&, std::map<std::string, std::string> const&)> const& f);
 
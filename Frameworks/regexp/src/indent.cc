@@ -19,7 +19,7 @@ namespace indent
 		return res;
 	}
 
-	static size_t classify (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns)
+	static size_t classify (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns)
 	{
 		size_t res = 0;
 		for(auto pair : patterns)
@@ -38,14 +38,14 @@ namespace indent
 		return res;
 	}
 
-	static bool is_blank (std::string const& line)                                           { return text::is_blank(line.data(), line.data() + line.size()); }
-	static size_t leading_whitespace (std::string const& line, size_t tabSize)               { return leading_whitespace(line.data(), line.data() + line.size(), tabSize); }
+	static bool is_blank (std::string_view line)                                           { return text::is_blank(line.data(), line.data() + line.size()); }
+	static size_t leading_whitespace (std::string_view line, size_t tabSize)               { return leading_whitespace(line.data(), line.data() + line.size(), tabSize); }
 
 	// =========
 	// = fsm_t =
 	// =========
 
-	bool fsm_t::is_seeded (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns)
+	bool fsm_t::is_seeded (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns)
 	{
 		bool res = true;
 		size_t type = classify(line, patterns);
@@ -80,12 +80,12 @@ namespace indent
 		return res;
 	}
 
-	bool fsm_t::is_ignored (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns) const
+	bool fsm_t::is_ignored (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns) const
 	{
 		return is_blank(line) || (classify(line, patterns) & kIgnore);
 	}
 
-	size_t fsm_t::scan_line (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns)
+	size_t fsm_t::scan_line (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns)
 	{
 		int type = classify(line, patterns);
 		ssize_t res = _level + _carry;
@@ -3,6 +3,7 @@
 
 #include "regexp.h"
 #include <oak/oak.h>
+#include <string_view>
 
 namespace indent
 {
@@ -24,9 +25,9 @@ namespace indent
 		{
 		}
 
-		bool is_seeded (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns);
-		bool is_ignored (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns) const;
-		size_t scan_line (std::string const& line, std::map<pattern_type, regexp::pattern_t> const& patterns); // returns indent for this line
+		bool is_seeded (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns);
+		bool is_ignored (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns) const;
+		size_t scan_line (std::string_view line, std::map<pattern_type, regexp::pattern_t> const& patterns); // returns indent for this line
 
 	private:
 		ssize_t _indent_size, _tab_size;
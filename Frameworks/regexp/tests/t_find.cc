@@ -1,4 +1,5 @@
 #include <regexp/find.h>
+#include <oak/duration.h>
 
 typedef std::pair<size_t, size_t> range_t;
 
@@ -29,3 +30,249 @@ void test_regexp_backward ()
 	OAK_ASSERT_EQ(ranges.size(), 1);
 	OAK_ASSERT_EQ(ranges[0], range_t(6, 17));
 }
+
+static std::vector<range_t> chunked_matches (find::find_t matcher, std::string const& text, size_t chunkSize)
+{
+	std::vector<range_t> res;
+	for(size_t i = 0; i < text.size(); i += chunkSize)
+	{
+		matcher.each_match(text.data() + i, std::min(chunkSize, text.size() - i), i + chunkSize < text.size(), [&res](std::pair<size_t, size_t> const& m, std::map<std::string, std::string> const& captures){
+			res.push_back(m);
+		});
+	}
+	return res;
+}
+
+void test_literal_chunk_boundaries ()
+{
+	std::string const text = "xx foobar foofoobar FOOBAR foo\tbar fooba foo  bar\nfoo grød grØd grød";
+
+	std::vector<range_t> const exact = { { 3, 9 }, { 13, 19 } };
+	std::vector<range_t> const ignoreCase = { { 3, 9 }, { 13, 19 }, { 20, 26 } };
+	std::vector<range_t> const ignoreWhitespace = { { 3, 9 }, { 13, 19 }, { 27, 34 }, { 41, 49 } };
+	std::vector<range_t> const utf8 = { { 54, 59 }, { 66, 71 } };
+
+	for(size_t chunkSize = 1; chunkSize <= text.size(); ++chunkSize)
+	{
+		OAK_ASSERT(chunked_matches(find::find_t("foobar"), text, chunkSize) == exact);
+		OAK_ASSERT(chunked_matches(find::find_t("fOObar", find::ignore_case), text, chunkSize) == ignoreCase);
+		OAK_ASSERT(chunked_matches(find::find_t("foo bar", find::ignore_whitespace), text, chunkSize) == ignoreWhitespace);
+		OAK_ASSERT(chunked_matches(find::find_t("grød"), text, chunkSize) == utf8);
+	}
+}
+
+void test_literal_overlapping_prefix ()
+{
+	std::vector<range_t> const expected = { { 2, 5 }, { 6, 9 } };
+	for(size_t chunkSize = 1; chunkSize < 12; ++chunkSize)
+		OAK_ASSERT(chunked_matches(find::find_t("aab"), "aaaabaaab", chunkSize) == expected);
+}
+
+static std::vector<std::pair<range_t, std::string>> regexp_matches (std::string const& pattern, std::string const& text, size_t chunkSize, find::options_t options, find::window_t const& window = find::window_t())
+{
+	std::vector<std::pair<range_t, std::string>> res;
+	find::find_t matcher(pattern, find::regular_expression | options, window);
+	auto callback = [&res](std::pair<size_t, size_t> const& m, std::map<std::string, std::string> const& captures){
+		auto capture = captures.find("1");
+		res.emplace_back(m, capture != captures.end() ? capture->second : "");
+	};
+
+	for(size_t i = 0; i < text.size(); i += chunkSize)
+		matcher.each_match(text.data() + i, std::min(chunkSize, text.size() - i), true, callback);
+	matcher.each_match(nullptr, 0, false, callback);
+
+	return res;
+}
+
+void test_windowed_regexp ()
+{
+	std::string text;
+	for(size_t i = 0; i < 40; ++i)
+		text += "foo bar\nfoobar grød øbar\n\n(baz) barø x" + std::to_string(i) + "\n";
+
+	static std::string const patterns[] = { "foo", "^foo", "bar$", "\\bbar\\b", "^", "$", "o*", "(o+)b", "(?<=x)\\d+", "\\n\\n", "ø+", "\\Afoo", "\\d+\\n\\z", "f.{0,6}r" };
+	static find::window_t const windows[] = { { 64, 16 }, { 100, 30 }, { 1000, 64 } };
+
+	for(auto const& pattern : patterns)
+	{
+		auto const expected = regexp_matches(pattern, text, text.size(), find::none);
+		OAK_ASSERT(!expected.empty());
+
+		for(size_t chunkSize : { 1, 7, 64, 5000 })
+		{
+			for(auto const& window : windows)
+				OAK_ASSERT(regexp_matches(pattern, text, chunkSize, find::windowed, window) == expected);
+		}
+	}
+}
+
+void test_windowed_regexp_buffer_anchors ()
+{
+	std::string text;
+	for(size_t i = 0; i < 40; ++i)
+		text += "word" + std::string(20 + i % 7, 'x') + std::to_string(i) + " ";
+	text += "last\n";
+
+	static std::string const patterns[] = { "\\A\\w+", "\\w+\\z", "\\w+\\n\\z", "\\w+\\Z", "\\w+ \\Z" };
+	static find::window_t const windows[] = { { 64, 16 }, { 100, 30 }, { 256, 64 } };
+
+	for(auto const& pattern : patterns)
+	{
+		auto const expected = regexp_matches(pattern, text, text.size(), find::none);
+		for(size_t chunkSize : { 1, 7, 64, 5000 })
+		{
+			for(auto const& window : windows)
+				OAK_ASSERT(regexp_matches(pattern, text, chunkSize, find::windowed, window) == expected);
+		}
+	}
+
+	OAK_ASSERT_EQ(regexp_matches("\\w+\\z", text, 7, find::windowed, { 64, 16 }).size(), 0);
+	OAK_ASSERT_EQ(regexp_matches("\\w+\\Z", text, 7, find::windowed, { 64, 16 }).size(), 1);
+	OAK_ASSERT_EQ(regexp_matches("\\w+\\Z", text, 7, find::windowed, { 64, 16 }).front().first, range_t(text.size() - 5, text.size() - 1));
+	OAK_ASSERT_EQ(regexp_matches("\\A\\w+", text, 7, find::windowed, { 64, 16 }).size(), 1);
+}
+
+void test_windowed_regexp_long_match ()
+{
+	std::string text;
+	for(size_t i = 0; i < 10; ++i)
+		text += "x" + std::string(50 + 40 * i, 'a') + "y\n";
+
+	static std::string const patterns[] = { "a+", "xa*", "x([^\\n]*)" };
+	static find::window_t const windows[] = { { 64, 16 }, { 100, 30 } };
+
+	for(auto const& pattern : patterns)
+	{
+		auto const expected = regexp_matches(pattern, text, text.size(), find::none);
+		for(size_t chunkSize : { 1, 7, 64, 5000 })
+		{
+			for(auto const& window : windows)
+				OAK_ASSERT(regexp_matches(pattern, text, chunkSize, find::windowed, window) == expected);
+		}
+	}
+}
+
+void test_windowed_regexp_beyond_filesize_limit ()
+{
+	std::string const line = "lorem ipsum dolor sit amet\n";
+	std::string text;
+	while(text.size() < 6*1024*1024)
+		text += line;
+	text += "needle\n";
+
+	auto const matches = regexp_matches("^needle$", text, 64*1024, find::windowed, { 256*1024, 1024 });
+	OAK_ASSERT_EQ(matches.size(), 1);
+	OAK_ASSERT_EQ(matches.front().first, range_t(text.size() - 7, text.size() - 1));
+}
+
+// A top-level alternation disables the required literal filter, and (?!) never matches, so this gives us results without the filter
+static std::string without_prefilter (std::string const& pattern)
+{
+	return "(?!)|" + pattern;
+}
+
+void test_regexp_prefilter ()
+{
+	std::string text;
+	for(size_t i = 0; i < 50; ++i)
+		text += "foo bar\nfoobarBAR ﬁle K " + std::to_string(i) + "bar\nbaz(foo.)\n\nfo-o " + (i % 7 == 0 ? "needle" : "haystack") + "\n";
+
+	static std::string const patterns[] = {
+		"foo", "fo+bar", "\\w+bar", "ba[rz]\\d?", "BAR", "x?foo\\.", "bar$", "^foo", "(foo|bar)\\n", "foo|bar", "o{2}b", "o{0,2}bar", "\\bbar\\b",
+		"bar\\s+foo", "bar\\nbaz", "[^x]bar", "(?<=o)bar", "\\d+bar", "f\\w*?e", "ob(?=a)", "fo\\-o", "needle", "(?i)NEEDLE", "fi", "k ",
+	};
+
+	for(auto const& pattern : patterns)
+	{
+		for(auto options : { find::none, find::ignore_case })
+		{
+			auto const expected = regexp_matches(without_prefilter(pattern), text, text.size(), options);
+			OAK_ASSERT(regexp_matches(pattern, text, text.size(), options) == expected);
+			OAK_ASSERT(regexp_matches(pattern, text, 100, options | find::windowed, { 256, 64 }) == regexp_matches(without_prefilter(pattern), text, 100, options | find::windowed, { 256, 64 }));
+		}
+	}
+}
+
+void test_regexp_prefilter_escapes ()
+{
+	std::string text;
+	for(size_t i = 0; i < 50; ++i)
+		text += "foo bar\nfoobarBAR ]bar x" + std::to_string(i) + "bar\nbaz(foo.)\n";
+
+	// Escape arguments are part of the escape and must not end up in the required literal
+	static std::string const patterns[] = {
+		"\\x66oo", "\\x{66}oo", "\\146oo", "\\cJbaz", "\\C-jbaz", "\\p{Alpha}oo", "\\P{Space}oo",
+		"(?<q>o)\\k<q>bar", "(?<q>o)\\k'q'bar", "(o)\\1bar", "(?<o>o)\\g<o>bar", "(?<o>o)\\g'o'bar",
+		"[]x]bar", "[^]x]bar", "[]]bar", "([o)])bar",
+	};
+
+	for(auto const& pattern : patterns)
+	{
+		auto const expected = regexp_matches(without_prefilter(pattern), text, text.size(), find::none);
+		OAK_ASSERT(!expected.empty());
+		OAK_ASSERT(regexp_matches(pattern, text, text.size(), find::none) == expected);
+		OAK_ASSERT(regexp_matches(pattern, text, 100, find::windowed, { 256, 64 }) == regexp_matches(without_prefilter(pattern), text, 100, find::windowed, { 256, 64 }));
+	}
+}
+
+void benchmark_regexp_prefilter ()
+{
+	// Simulate a folder search where few files contain the required literal
+	std::vector<std::string> files;
+	for(size_t i = 0; i < 500; ++i)
+	{
+		std::string file;
+		for(size_t j = 0; j < 400; ++j)
+			file += "\tif(value != nullptr && item" + std::to_string(j) + "->isValid()) return 42;\n";
+		if(i % 50 == 0)
+			file += "@interface OakFindController : NSWindowController\n";
+		files.push_back(file);
+	}
+
+	auto search = [&files](std::string const& pattern){
+		size_t res = 0;
+		for(auto const& file : files)
+			res += regexp_matches(pattern, file, file.size(), find::none).size();
+		return res;
+	};
+
+	oak::duration_t timer;
+	size_t const unfilteredMatches = search(without_prefilter("\\w+Controller\\b"));
+	double const unfiltered = timer.duration();
+
+	timer.reset();
+	size_t const filteredMatches = search("\\w+Controller\\b");
+	double const filtered = timer.duration();
+
+	OAK_ASSERT_EQ(unfilteredMatches, filteredMatches);
+	fprintf(stdout, "%zu files: %.1f ms without literal filter, %.1f ms with (%.1f× speedup)\n", files.size(), unfiltered * 1000, filtered * 1000, unfiltered / filtered);
+}
+
+static void literal_throughput (char const* corpusName, std::string const& unit, std::string const& searchFor, find::options_t options)
+{
+	std::string corpus;
+	while(corpus.size() < 64*1024*1024)
+		corpus += unit;
+
+	size_t const chunkSize = 64*1024, rounds = 4;
+	size_t matches = 0;
+
+	oak::duration_t timer;
+	for(size_t n = 0; n < rounds; ++n)
+		matches += chunked_matches(find::find_t(searchFor, options), corpus, chunkSize).size();
+	double const duration = timer.duration();
+
+	fprintf(stdout, "%-5s %-18s %5.2f GB/s (%zu matches)\n", corpusName, (options & find::ignore_whitespace) ? "ignore whitespace" : (options & find::ignore_case) ? "ignore case" : "exact", rounds * corpus.size() / duration / 1e9, matches / rounds);
+}
+
+void benchmark_literal_find ()
+{
+	std::string const ascii = "The quick brown fox jumps over the lazy dog while the cat sleeps.\n";
+	std::string const utf8  = "Høj rød grød med fløde, 素早い茶色の狐が怠け者の犬を飛び越える。\n";
+
+	for(auto options : { find::none, find::ignore_case, find::ignore_whitespace })
+	{
+		literal_throughput("ASCII", ascii, "lazy cat", options);
+		literal_throughput("UTF-8", utf8, "狐が眠る", options);
+	}
+}
@@ -4,50 +4,159 @@
 #include <text/parse.h>
 #include <text/tokenize.h>
 #include <oak/oak.h>
+#include <shared_mutex>
+#include <unordered_map>
+#include <string_view>
+#include <array>
 
 namespace scope
 {
 	scope_t wildcard("x-any");
 
-	// ===================
-	// = scope_t::node_t =
-	// ===================
+	// ===========================
+	// = scope_t::intern_table_t =
+	// ===========================
 
-	scope_t::node_t::node_t (std::string const& atoms, node_t* parent) : _atoms(atoms), _parent(parent), _retain_count(1), _hash(std::hash<std::string>()(atoms) ^ (parent ? parent->_hash : 0))
+	// Atoms are never freed, nodes are removed from the table when their retain count drops to zero. The retain count only goes from one to zero while holding the lock of the node’s shard, so a lookup never returns a node which is being deleted.
+	struct scope_t::intern_table_t
 	{
-	}
+		static intern_table_t& shared ()
+		{
+			static intern_table_t* table = new intern_table_t; // leaked so that scopes can be released during static destruction
+			return *table;
+		}
 
-	scope_t::node_t::~node_t ()
-	{
-		if(_parent)
-			_parent->release();
-	}
+		atom_t const* atom (std::string const& str)
+		{
+			{
+				std::shared_lock<std::shared_mutex> lock(_atoms_mutex);
+				auto it = _atoms.find(str);
+				if(it != _atoms.end())
+					return it->second;
+			}
+
+			std::vector<uint32_t> prefixes;
+			for(size_t i = str.find('.'); i != std::string::npos; i = str.find('.', i + 1))
+				prefixes.push_back(atom(str.substr(0, i))->id);
+
+			std::unique_lock<std::shared_mutex> lock(_atoms_mutex);
+			auto it = _atoms.find(str);
+			if(it != _atoms.end())
+				return it->second;
+
+			bool isAuxiliary = strncmp(str.c_str(), "attr.", 5) == 0 || strncmp(str.c_str(), "dyn.", 4) == 0;
+			atom_t* atom = new atom_t{ str, (uint32_t)_atoms.size(), std::hash<std::string>()(str), prefixes.size() + 1, isAuxiliary, std::move(prefixes) };
+			atom->prefixes.push_back(atom->id);
+			_atoms.emplace(atom->str, atom);
+			_atom_bytes += sizeof(atom_t) + str.capacity() + atom->prefixes.capacity() * sizeof(uint32_t);
+			return atom;
+		}
 
-	void scope_t::node_t::retain ()
-	{
-		++_retain_count;
-	}
+		// Returns a retained node
+		node_t* node (atom_t const* atom, node_t* parent)
+		{
+			shard_t& shard = shard_for(atom, parent);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+
+			auto it = shard.nodes.find({ parent, atom->id });
+			if(it != shard.nodes.end())
+			{
+				it->second->retain();
+				return it->second;
+			}
+
+			if(parent)
+				parent->retain();
+			node_t* res = new node_t(atom, parent);
+			shard.nodes.emplace(std::make_pair(parent, atom->id), res);
+			return res;
+		}
 
-	void scope_t::node_t::release ()
+		void release (node_t* node)
+		{
+			while(node)
+			{
+				size_t count = node->_retain_count.load();
+				while(count > 1)
+				{
+					if(node->_retain_count.compare_exchange_weak(count, count - 1))
+						return;
+				}
+
+				shard_t& shard = shard_for(node->_atom, node->_parent);
+				{
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					if(--node->_retain_count != 0)
+						return;
+					shard.nodes.erase({ node->_parent, node->_atom->id });
+				}
+
+				node_t* parent = node->_parent;
+				delete node;
+				node = parent;
+			}
+		}
+
+		statistics_t statistics ()
+		{
+			size_t nodes = 0;
+			for(auto& shard : _shards)
+			{
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				nodes += shard.nodes.size();
+			}
+
+			std::shared_lock<std::shared_mutex> lock(_atoms_mutex);
+			return { nodes, _atoms.size(), nodes * sizeof(node_t) + _atom_bytes };
+		}
+
+	private:
+		typedef std::pair<node_t*, uint32_t> key_t;
+
+		struct key_hash_t
+		{
+			size_t operator() (key_t const& key) const { return std::hash<node_t*>()(key.first) ^ (key.second * 0x9e3779b97f4a7c15ULL); }
+		};
+
+		struct shard_t
+		{
+			std::mutex mutex;
+			std::unordered_map<key_t, node_t*, key_hash_t> nodes;
+		};
+
+		shard_t& shard_for (atom_t const* atom, node_t* parent)
+		{
+			return _shards[key_hash_t()({ parent, atom->id }) % _shards.size()];
+		}
+
+		std::shared_mutex _atoms_mutex;
+		std::unordered_map<std::string_view, atom_t*> _atoms;
+		size_t _atom_bytes = 0;
+
+		std::array<shard_t, 16> _shards;
+	};
+
+	statistics_t statistics ()
 	{
-		bool shouldDelete = --_retain_count == 0;
-		if(shouldDelete)
-			delete this;
+		return scope_t::intern_table_t::shared().statistics();
 	}
 
-	bool scope_t::node_t::is_auxiliary_scope () const
+	// ===================
+	// = scope_t::node_t =
+	// ===================
+
+	scope_t::node_t::node_t (atom_t const* atom, node_t* parent) : _atom(atom), _parent(parent), _retain_count(1), _hash(atom->hash ^ (parent ? parent->_hash * 31 : 0))
 	{
-		return strncmp(c_str(), "attr.", 5) == 0 || strncmp(c_str(), "dyn.", 4) == 0;
 	}
 
-	size_t scope_t::node_t::number_of_atoms () const
+	void scope_t::node_t::retain ()
 	{
-		return std::count(_atoms.begin(), _atoms.end(), '.') + 1;
+		++_retain_count;
 	}
 
-	char const* scope_t::node_t::c_str () const
+	void scope_t::node_t::release ()
 	{
-		return _atoms.c_str();
+		intern_table_t::shared().release(this);
 	}
 
 	// =========
@@ -110,16 +219,20 @@ namespace scope
 
 	bool scope_t::has_prefix (scope_t const& rhs) const
 	{
-		scope_t lhs = *this;
-		ssize_t lhsSize = lhs.size(), rhsSize = rhs.size();
+		node_t* n = node;
+		ssize_t lhsSize = size(), rhsSize = rhs.size();
 		for(ssize_t i = 0; i < lhsSize - rhsSize; ++i)
-			lhs.pop_scope();
-		return lhs == rhs;
+			n = n->parent();
+		return n == rhs.node;
 	}
 
 	void scope_t::push_scope (std::string const& atom)
 	{
-		node = new node_t(atom, node);
+		intern_table_t& table = intern_table_t::shared();
+		node_t* parent = node;
+		node = table.node(table.atom(atom), parent);
+		if(parent)
+			parent->release();
 	}
 
 	void scope_t::pop_scope ()
@@ -134,7 +247,7 @@ namespace scope
 	std::string const& scope_t::back () const
 	{
 		ASSERT(node);
-		return node->_atoms;
+		return node->_atom->str;
 	}
 
 	size_t scope_t::size () const
@@ -152,24 +265,18 @@ namespace scope
 
 	bool scope_t::operator== (scope_t const& rhs) const
 	{
-		auto n1 = node, n2 = rhs.node;
-		while(n1 != n2 && n1 && n2 && n1->_atoms == n2->_atoms)
-		{
-			n1 = n1->parent();
-			n2 = n2->parent();
-		}
-		return n1 == n2;
+		return node == rhs.node;
 	}
 
 	bool scope_t::operator< (scope_t const& rhs) const
 	{
 		auto n1 = node, n2 = rhs.node;
-		while(n1 != n2 && n1 && n2 && n1->_atoms == n2->_atoms)
+		while(n1 != n2 && n1 && n2 && n1->_atom == n2->_atom)
 		{
 			n1 = n1->parent();
 			n2 = n2->parent();
 		}
-		return (!n1 && n2) || (n1 && n2 && n1->_atoms < n2->_atoms);
+		return (!n1 && n2) || (n1 && n2 && n1 != n2 && n1->_atom->str < n2->_atom->str);
 	}
 
 	bool scope_t::operator!= (scope_t const& rhs) const   { return !(*this == rhs); }
@@ -187,7 +294,7 @@ namespace scope
 		for(size_t i = lhsSize; i < rhsSize; ++i)
 			n2 = n2->parent();
 
-		while(n1 && n2 && n1->_atoms != n2->_atoms)
+		while(n1 != n2)
 		{
 			n1 = n1->parent();
 			n2 = n2->parent();
@@ -223,7 +330,7 @@ namespace scope
 			to_s_helper(p, out);
 			out.append(1, ' ');
 		}
-		out.append(n->_atoms);
+		out.append(n->_atom->str);
 	}
 
 	scope_t::operator std::string () const
@@ -274,4 +381,125 @@ namespace scope
 			return scope.left == wildcard || scope.right == wildcard || selector->does_match(scope.left, scope.right, &rank) ? rank : std::optional<double>();
 		return 0;
 	}
+
+	// ==================
+	// = selector_set_t =
+	// ==================
+
+	// Atoms of which at least one must be present in the scope for a selector to match, or std::nullopt when the selector can match without any particular atom (negation, wildcards, …)
+	typedef std::optional<std::set<std::string>> required_atoms_t;
+
+	static required_atoms_t required_atoms (types::selector_t const& selector);
+
+	static required_atoms_t merge (required_atoms_t lhs, required_atoms_t const& rhs)
+	{
+		if(!lhs || !rhs)
+			return std::nullopt;
+		lhs->insert(rhs->begin(), rhs->end());
+		return lhs;
+	}
+
+	static required_atoms_t required_atoms (types::any_ptr const& selector)
+	{
+		if(auto path = std::dynamic_pointer_cast<types::path_t>(selector))
+		{
+			riterate(it, path->scopes)
+			{
+				if(it->atoms.find('*') == std::string::npos)
+					return std::set<std::string>{ it->atoms };
+			}
+		}
+		else if(auto group = std::dynamic_pointer_cast<types::group_t>(selector))
+		{
+			return required_atoms(group->selector);
+		}
+		else if(auto filter = std::dynamic_pointer_cast<types::filter_t>(selector))
+		{
+			return required_atoms(filter->selector);
+		}
+		return std::nullopt;
+	}
+
+	static required_atoms_t required_atoms (types::composite_t const& composite)
+	{
+		required_atoms_t res = std::set<std::string>(); // an empty composite never matches
+		for(auto const& expr : composite.expressions)
+		{
+			required_atoms_t local = expr.negate ? std::nullopt : required_atoms(expr.selector);
+			switch(expr.op)
+			{
+				case types::expression_t::op_none:  res = local;             break;
+				case types::expression_t::op_or:    res = merge(res, local); break;
+				case types::expression_t::op_and:   res = !res || local && local->size() < res->size() ? local : res; break;
+				case types::expression_t::op_minus: break;
+			}
+		}
+		return res;
+	}
+
+	static required_atoms_t required_atoms (types::selector_t const& selector)
+	{
+		required_atoms_t res = std::set<std::string>();
+		for(auto const& composite : selector.composites)
+			res = merge(res, required_atoms(composite));
+		return res;
+	}
+
+	size_t selector_set_t::add (selector_t const& selector)
+	{
+		size_t const index = _selectors.size();
+		_selectors.push_back(selector);
+
+		required_atoms_t atoms = selector.selector ? required_atoms(*selector.selector) : std::nullopt;
+		if(!atoms)
+		{
+			_unindexed.push_back(index);
+			return index;
+		}
+
+		scope_t::intern_table_t& table = scope_t::intern_table_t::shared();
+		for(auto const& atom : *atoms)
+			_index[table.atom(atom)->id].push_back(index);
+
+		return index;
+	}
+
+	std::vector<std::pair<size_t, double>> selector_set_t::match (context_t const& scope) const
+	{
+		std::vector<size_t> candidates = _unindexed;
+		if(scope.left == wildcard || scope.right == wildcard)
+		{
+			candidates.resize(_selectors.size());
+			std::iota(candidates.begin(), candidates.end(), 0);
+		}
+		else
+		{
+			for(scope_t const* side : { &scope.left, &scope.right })
+			{
+				for(scope_t::node_t const* node = side->node; node; node = node->parent())
+				{
+					for(uint32_t id : node->_atom->prefixes)
+					{
+						auto it = _index.find(id);
+						if(it != _index.end())
+							candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+					}
+				}
+
+				if(scope.left == scope.right)
+					break;
+			}
+
+			std::sort(candidates.begin(), candidates.end());
+			candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+		}
+
+		std::vector<std::pair<size_t, double>> res;
+		for(size_t index : candidates)
+		{
+			if(auto rank = _selectors[index].does_match(scope))
+				res.emplace_back(index, *rank);
+		}
+		return res;
+	}
 }
@@ -2,6 +2,7 @@
 #define SCOPE_SELECTOR_H_WZ1A8GIC
 
 #include <oak/debug.h>
+#include <unordered_map>
 
 namespace scope
 {
@@ -13,6 +14,16 @@ namespace scope
 
 	} /* types */
 
+	// Number of distinct scope nodes and atoms currently interned
+	struct statistics_t
+	{
+		size_t nodes;
+		size_t atoms;
+		size_t bytes;
+	};
+
+	statistics_t statistics ();
+
 	struct scope_t
 	{
 		scope_t ();
@@ -42,28 +53,43 @@ namespace scope
 		explicit operator std::string () const;
 
 	private:
+		struct atom_t
+		{
+			std::string str;
+			uint32_t id;
+			size_t hash;
+			size_t number_of_atoms;
+			bool is_auxiliary_scope;
+			std::vector<uint32_t> prefixes; // ids of all the atoms this atom matches, e.g. ‘string’, ‘string.quoted’, and ‘string.quoted.double’
+		};
+
+		// Nodes are interned so that structurally identical scopes share the same node, making equality a pointer comparison
 		struct node_t
 		{
-			node_t (std::string const& atoms, node_t* parent);
-			~node_t ();
+			node_t (atom_t const* atom, node_t* parent);
 
 			void retain ();
 			void release ();
 
-			bool is_auxiliary_scope () const;
-			size_t number_of_atoms () const;
-			char const* c_str () const;
-			node_t* parent () const { return _parent; }
+			bool is_auxiliary_scope () const { return _atom->is_auxiliary_scope; }
+			size_t number_of_atoms () const  { return _atom->number_of_atoms; }
+			char const* c_str () const       { return _atom->str.c_str(); }
+			node_t* parent () const          { return _parent; }
 
 		private:
 			friend scope_t;
 			friend scope_t shared_prefix (scope_t const& lhs, scope_t const& rhs);
-			std::string _atoms;
+			friend struct selector_set_t;
+			atom_t const* _atom;
 			node_t* _parent;
 			std::atomic_size_t _retain_count;
 			size_t _hash;
 		};
 
+		struct intern_table_t;
+		friend statistics_t statistics ();
+		friend struct selector_set_t;
+
 		explicit scope_t (node_t* node);
 		void setup (std::string const& str);
 		void to_s_helper (scope_t::node_t* n, std::string& out) const;
@@ -106,11 +132,27 @@ namespace scope
 		void setup (std::string const& str);
 
 		friend std::string to_s (selector_t const& s);
+		friend struct selector_set_t;
 		types::selector_ptr selector;
 	};
 
 	std::string to_s (selector_t const& s);
 
+	// Index over many selectors which only tests those that can possibly match a given context. Each selector is keyed on the atoms of which (at least) one must be present in the scope for the selector to match.
+	struct selector_set_t
+	{
+		size_t add (selector_t const& selector);
+		size_t size () const { return _selectors.size(); }
+
+		// Returns index and rank of matching selectors, ordered by index
+		std::vector<std::pair<size_t, double>> match (context_t const& scope) const;
+
+	private:
+		std::vector<selector_t> _selectors;
+		std::vector<size_t> _unindexed;
+		std::unordered_map<uint32_t, std::vector<size_t>> _index;
+	};
+
 } /* scope */
 
 template<> struct std::hash<scope::scope_t>
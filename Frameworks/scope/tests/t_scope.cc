@@ -37,3 +37,50 @@ void test_operator_bool ()
 	scope.pop_scope();
 	OAK_ASSERT(!scope);
 }
+
+void test_scope_interning ()
+{
+	size_t const nodes = scope::statistics().nodes;
+	{
+		scope::scope_t lhs("source.c meta.block.c string.quoted.double.c");
+		scope::scope_t rhs("source.c meta.block.c");
+		OAK_ASSERT_NE(lhs, rhs);
+		OAK_ASSERT_EQ(scope::statistics().nodes, nodes + 3);
+
+		rhs.push_scope("string.quoted.double.c");
+		OAK_ASSERT_EQ(lhs, rhs);
+		OAK_ASSERT_EQ(lhs.hash(), rhs.hash());
+		OAK_ASSERT_EQ(scope::statistics().nodes, nodes + 3);
+
+		rhs.pop_scope();
+		rhs.push_scope("string.quoted.single.c");
+		OAK_ASSERT_NE(lhs, rhs);
+		OAK_ASSERT_EQ(scope::statistics().nodes, nodes + 4);
+	}
+	OAK_ASSERT_EQ(scope::statistics().nodes, nodes);
+}
+
+void test_concurrent_interning ()
+{
+	scope::scope_t const expected("source.c meta.block.c meta.block.c string.quoted.double.c");
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < 8; ++i)
+	{
+		threads.emplace_back([&expected](){
+			for(size_t j = 0; j < 10000; ++j)
+			{
+				scope::scope_t scope("source.c");
+				scope.push_scope("meta.block.c");
+				scope.push_scope("meta.block.c");
+				scope.push_scope("string.quoted.double.c");
+				OAK_ASSERT_EQ(scope, expected);
+				scope.pop_scope();
+				scope.push_scope(j % 2 ? "string.quoted.single.c" : "comment.block.c");
+				OAK_ASSERT_NE(scope, expected);
+			}
+		});
+	}
+
+	for(auto& thread : threads)
+		thread.join();
+}
@@ -0,0 +1,113 @@
+#include <scope/scope.h>
+#include <oak/duration.h>
+
+static std::vector<std::pair<size_t, double>> linear_match (std::vector<scope::selector_t> const& selectors, scope::context_t const& scope)
+{
+	std::vector<std::pair<size_t, double>> res;
+	for(size_t i = 0; i < selectors.size(); ++i)
+	{
+		if(auto rank = selectors[i].does_match(scope))
+			res.emplace_back(i, *rank);
+	}
+	return res;
+}
+
+void test_selector_set ()
+{
+	static std::string const selectors[] = {
+		"source", "string", "string.quoted", "string.quoted.double.c", "source.c string", "source.c string.quoted.single",
+		"comment, string", "(comment | string) - string.quoted.single", "text - source", "- string", "source & comment",
+		"*", "source.* string", "string.*.double", "source > meta.block string", "^ source.c", "meta.block $",
+		"L:source.c", "R:string", "B:meta", "meta.block.c - (string | comment)", "", "dyn.selection", "source.c.embedded",
+	};
+
+	static std::string const scopes[] = {
+		"", "source.c", "source.c meta.block.c", "source.c meta.block.c string.quoted.double.c",
+		"source.c meta.block.c string.quoted.single.c", "source.c comment.line.double-slash.c", "text.html.basic source.c.embedded.html",
+		"source.c meta.block.c meta.block.c dyn.selection", "text.plain", "source.c string.quoted.double.c constant.character.escape.c",
+	};
+
+	std::vector<scope::selector_t> linear;
+	scope::selector_set_t set;
+	for(auto const& selector : selectors)
+	{
+		linear.emplace_back(selector);
+		OAK_ASSERT_EQ(set.add(selector), linear.size() - 1);
+	}
+	linear.emplace_back();
+	set.add(scope::selector_t());
+
+	for(auto const& left : scopes)
+	{
+		for(auto const& right : scopes)
+		{
+			scope::context_t const context(left, right);
+			OAK_ASSERT(set.match(context) == linear_match(linear, context));
+		}
+	}
+
+	OAK_ASSERT_EQ(set.match(scope::wildcard).size(), linear_match(linear, scope::wildcard).size());
+}
+
+void benchmark_selector_set ()
+{
+	// Selectors follow what is found in larger themes: a language root, optionally scoped to a language, optionally combined with a parent context
+	static std::string const roots[] = {
+		"comment", "comment.line", "comment.block", "comment.block.documentation", "constant", "constant.numeric", "constant.character.escape", "constant.language",
+		"entity.name.function", "entity.name.type", "entity.name.tag", "entity.other.attribute-name", "entity.other.inherited-class", "invalid", "invalid.deprecated",
+		"keyword", "keyword.control", "keyword.operator", "markup.heading", "markup.bold", "markup.italic", "markup.inserted", "markup.deleted", "markup.list",
+		"meta.tag", "meta.function-call", "punctuation.definition.string", "punctuation.definition.comment", "storage", "storage.type", "storage.modifier",
+		"string", "string.quoted", "string.regexp", "string.unquoted", "support.function", "support.class", "support.constant", "variable", "variable.parameter",
+	};
+	static std::string const languages[] = { "", "c", "js", "ruby", "python", "html", "css" };
+
+	std::vector<std::string> selectors;
+	for(auto const& language : languages)
+	{
+		for(auto const& root : roots)
+			selectors.push_back(language.empty() ? root : "source." + language + " " + root);
+	}
+	selectors.push_back("text.html source.js.embedded - (string | comment)");
+	selectors.push_back("meta.diff, meta.diff.header");
+
+	std::vector<scope::scope_t> scopes;
+	for(auto const& language : languages)
+	{
+		for(auto const& root : roots)
+		{
+			std::string const leaf = root + "." + (language.empty() ? "txt" : language);
+			scopes.emplace_back("source." + language + " meta.function." + language + " meta.block." + language + " " + leaf);
+			scopes.emplace_back("text.html.basic source." + language + ".embedded.html meta.block." + language + " " + leaf);
+		}
+	}
+
+	std::vector<scope::selector_t> linear;
+	scope::selector_set_t set;
+	for(auto const& selector : selectors)
+	{
+		linear.emplace_back(selector);
+		set.add(selector);
+	}
+
+	size_t const rounds = 20;
+	size_t linearMatches = 0, setMatches = 0;
+
+	oak::duration_t timer;
+	for(size_t i = 0; i < rounds; ++i)
+	{
+		for(auto const& scope : scopes)
+			linearMatches += linear_match(linear, scope).size();
+	}
+	double linearTime = timer.duration();
+
+	timer.reset();
+	for(size_t i = 0; i < rounds; ++i)
+	{
+		for(auto const& scope : scopes)
+			setMatches += set.match(scope).size();
+	}
+	double setTime = timer.duration();
+
+	OAK_ASSERT_EQ(linearMatches, setMatches);
+	fprintf(stdout, "%zu selectors × %zu scopes: %.1f ms linear, %.1f ms indexed (%.1f× speedup)\n", selectors.size(), scopes.size() * rounds, linearTime * 1000, setTime * 1000, linearTime / setTime);
+}
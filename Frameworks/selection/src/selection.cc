@@ -67,6 +67,120 @@ namespace ng
 		return kCharacterClassOther;
 	}
 
+	namespace
+	{
+		// Character classification for characters with a given scope where the scope to the left is the same (i.e. not the first character of a scope)
+		struct character_classifier_t
+		{
+			character_classifier_t (scope::scope_t const& scope)
+			{
+				bundles::item_ptr match;
+				plist::any_t value = bundles::value_for_setting("characterClass", scope, &match);
+				if(match)
+				{
+					_character_class = boost::get<std::string>(value);
+				}
+				else
+				{
+					value = bundles::value_for_setting("wordCharacters", scope, &match);
+					if(match)
+						_word_characters = boost::get<std::string>(value);
+				}
+
+				for(size_t ch = 0; ch < 0x80; ++ch)
+					_ascii[ch] = &classify(std::string(1, ch));
+			}
+
+			character_classifier_t (character_classifier_t const& rhs) = delete;
+			character_classifier_t& operator= (character_classifier_t const& rhs) = delete;
+
+			std::string const& classify (char ch) const { return *_ascii[(uint8_t)ch]; }
+
+			std::string const& classify (std::string const& ch) const
+			{
+				if(_character_class != NULL_STR)
+					return _character_class;
+				else if(text::is_word_char(ch) || _word_characters.find(ch) != std::string::npos)
+					return kCharacterClassWord;
+				else if(text::is_whitespace(ch))
+					return kCharacterClassSpace;
+				return kCharacterClassOther;
+			}
+
+		private:
+			std::string _character_class = NULL_STR;
+			std::string _word_characters;
+			std::string const* _ascii[0x80];
+		};
+	}
+
+	void character_class_runs (buffer_api_t const& buffer, size_t from, size_t to, std::function<void(size_t from, size_t to, std::string const& characterClass)> const& f)
+	{
+		std::unordered_map<scope::scope_t, std::unique_ptr<character_classifier_t>> classifiers;
+
+		std::string runClass = NULL_STR;
+		size_t runFrom = from;
+		auto add = [&](size_t index, std::string const& characterClass){
+			if(runClass != characterClass)
+			{
+				if(runFrom != index)
+					f(runFrom, index, runClass);
+				runClass = characterClass;
+				runFrom = index;
+			}
+		};
+
+		size_t i = from;
+		std::map<size_t, scope::scope_t> const scopes = buffer.scopes(from, to);
+		for(auto it = scopes.begin(); it != scopes.end(); ++it)
+		{
+			size_t const scopeFrom = from + it->first;
+			size_t const scopeTo   = std::next(it) == scopes.end() ? to : from + std::next(it)->first;
+			if(scopeTo <= i)
+				continue;
+
+			if(i == scopeFrom) // the scope to the left differs, so classify as any other character
+			{
+				add(i, character_class(buffer, i));
+				i += buffer[i].size();
+			}
+
+			auto& classifier = classifiers[it->second];
+			if(!classifier)
+				classifier = std::make_unique<character_classifier_t>(it->second);
+
+			std::string const text = i < scopeTo ? buffer.substr(i, scopeTo) : "";
+			std::string const* lastClass = nullptr;
+
+			size_t offset = 0;
+			while(offset < text.size())
+			{
+				// Characters followed by a non-ASCII byte can be part of a composed character sequence
+				if(offset + 1 < text.size() && (text[offset] & 0x80) == 0 && (text[offset+1] & 0x80) == 0)
+				{
+					std::string const& characterClass = classifier->classify(text[offset]);
+					if(&characterClass != lastClass)
+					{
+						add(i + offset, characterClass);
+						lastClass = &characterClass;
+					}
+					++offset;
+				}
+				else
+				{
+					std::string const ch = buffer[i + offset];
+					add(i + offset, classifier->classify(ch));
+					lastClass = nullptr;
+					offset += ch.size();
+				}
+			}
+			i += offset;
+		}
+
+		if(runFrom != to && runClass != NULL_STR)
+			f(runFrom, to, runClass);
+	}
+
 	static bool is_part_of_word (buffer_api_t const& buffer, size_t index)
 	{
 		return character_class(buffer, index) != kCharacterClassSpace && character_class(buffer, index) != kCharacterClassOther;
@@ -1316,6 +1430,83 @@ namespace ng
 		return res;
 	}
 
+	// Feeds the bytes in [from, to) to the find object, calling ‘callback’ for each match until it returns false, the end is reached, or the search is cancelled
+	static void each_match (buffer_api_t const& buffer, find::find_t& f, size_t from, size_t to, std::atomic_bool const* cancel, std::function<bool(range_t const&, std::map<std::string, std::string> const&)> const& callback)
+	{
+		bool done = from == to;
+		buffer.visit_data([&](char const* buf, size_t offset, size_t len, bool* stop){
+			if(done || offset + len <= from)
+				return;
+
+			size_t first = std::max(offset, from), last = std::min(offset + len, to);
+			f.each_match(buf + (first - offset), last - first, last < to, [&](std::pair<size_t, size_t> const& m, std::map<std::string, std::string> const& captures){
+				if(!done && !callback(range_t(from + m.first, from + m.second, false, false, true), captures))
+					done = true;
+			});
+			*stop = done = done || last == to || (cancel && *cancel);
+		});
+	}
+
+	// Search outward from the range and stop at the first match, only searching from the other end of the buffer when nothing is found. An empty result is returned if the search is cancelled.
+	std::map< range_t, std::map<std::string, std::string> > find_next (buffer_api_t const& buffer, range_t const& range, std::string const& searchFor, find::options_t options, bool* didWrap, std::atomic_bool const* cancel)
+	{
+		static size_t const kBackwardsWindowSize = 64*1024;
+
+		auto setDidWrap = [&didWrap](bool flag){ if(didWrap != nullptr) *didWrap = flag; };
+		setDidWrap(false);
+
+		std::map< range_t, std::map<std::string, std::string> > res;
+		if(searchFor == NULL_STR || searchFor == "")
+			return res;
+
+		typedef std::pair< range_t, std::map<std::string, std::string> > match_t;
+		find::options_t const findOptions = (find::options_t)(options & ~(find::backwards|find::wrap_around));
+
+		auto firstMatch = [&](size_t from) -> std::optional<match_t> {
+			std::optional<match_t> match;
+			find::find_t f(searchFor, findOptions);
+			each_match(buffer, f, from, buffer.size(), cancel, [&match](range_t const& range, std::map<std::string, std::string> const& captures){
+				match.emplace(range, captures);
+				return false;
+			});
+			return match;
+		};
+
+		// The matcher only runs forward so we search increasingly larger windows ending at ‘to’ and pick the last match
+		auto lastMatch = [&](size_t to) -> std::optional<match_t> {
+			std::optional<match_t> match;
+			for(size_t from = to, windowSize = kBackwardsWindowSize; from != 0 && !match && !(cancel && *cancel); windowSize *= 2)
+			{
+				from = windowSize < from ? from - windowSize : 0;
+
+				find::find_t f(searchFor, findOptions);
+				each_match(buffer, f, from, to, cancel, [&match](range_t const& range, std::map<std::string, std::string> const& captures){
+					match.emplace(range, captures);
+					return true;
+				});
+			}
+			return match;
+		};
+
+		bool wrapped = false;
+		std::optional<match_t> m = (options & find::backwards) ? lastMatch(range.min().index) : firstMatch(range.max().index);
+		if(!m && !(cancel && *cancel))
+		{
+			if(wrapped = (options & find::wrap_around))
+					m = (options & find::backwards) ? lastMatch(buffer.size()) : firstMatch(0);
+			else	m = (options & find::backwards) ? lastMatch(range.max().index) : firstMatch(range.min().index);
+		}
+
+		if(!m || (cancel && *cancel) || m->first.sorted() == range.sorted())
+			return res;
+
+		if(wrapped && !(range.min() <= m->first.min() && m->first.max() <= range.max()))
+			setDidWrap(true);
+
+		res.insert(*m);
+		return res;
+	}
+
 	static std::map< range_t, std::map<std::string, std::string> > regexp_find (buffer_api_t const& buffer, std::string const& searchFor, find::options_t options, ng::range_t const& range)
 	{
 		size_t first = (options & find::backwards) ? range.min().index : range.max().index;
@@ -1363,6 +1554,8 @@ namespace ng
 
 		if(selection.size() == 1 && (options & (find::regular_expression|find::wrap_around|find::all_matches|find::extend_selection)) == find::regular_expression)
 			return regexp_find(buffer, searchFor, options, selection.last());
+		else if(selection.size() == 1 && !selection.last().columnar && searchRanges.empty() && !(options & (find::regular_expression|find::all_matches|find::extend_selection)))
+			return find_next(buffer, selection.last(), searchFor, options, didWrap);
 
 		auto tmp = find_all(buffer, searchFor, options, searchRanges);
 		if(options & find::all_matches)
@@ -1492,25 +1685,10 @@ namespace ng
 	ranges_t all_words (buffer_api_t const& buffer)
 	{
 		ranges_t res;
-
-		std::string charType = kCharacterClassOther;
-		size_t from = 0;
-		for(size_t i = 0; i < buffer.size(); )
-		{
-			std::string newCharType = character_class(buffer, i);
-			if(charType != newCharType)
-			{
-				if(charType != kCharacterClassSpace && charType != kCharacterClassOther && from != i)
-					res.push_back(range_t(from, i));
-				charType = newCharType;
-				from = i;
-			}
-			i += buffer[i].size();
-		}
-
-		if(charType != kCharacterClassSpace && charType != kCharacterClassOther && from != buffer.size())
-			res.push_back(range_t(from, buffer.size()));
-
+		character_class_runs(buffer, 0, buffer.size(), [&res](size_t from, size_t to, std::string const& characterClass){
+			if(characterClass != kCharacterClassSpace && characterClass != kCharacterClassOther)
+				res.push_back(range_t(from, to));
+		});
 		return res;
 	}
 
@@ -41,6 +41,7 @@ namespace ng
 	ranges_t highlight_ranges_for_movement (buffer_api_t const& buffer, ranges_t const& oldSelection, ranges_t const& newSelection);
 	std::map< range_t, std::map<std::string, std::string> > find (buffer_api_t const& buffer, ranges_t const& selection, std::string const& searchFor, find::options_t options, ranges_t const& searchRanges = ranges_t(), bool* didWrap = nullptr);
 	std::map< range_t, std::map<std::string, std::string> > find_all (buffer_api_t const& buffer, std::string const& searchFor, find::options_t options, ranges_t const& searchRanges = ranges_t());
+	std::map< range_t, std::map<std::string, std::string> > find_next (buffer_api_t const& buffer, range_t const& range, std::string const& searchFor, find::options_t options, bool* didWrap = nullptr, std::atomic_bool const* cancel = nullptr);
 	range_t word_at (buffer_api_t const& buffer, range_t const& range);
 	ranges_t all_words (buffer_api_t const& buffer);
 
@@ -52,6 +53,7 @@ namespace ng
 	extern std::string const kCharacterClassUnknown;
 
 	std::string character_class (buffer_api_t const& buffer, size_t index);
+	void character_class_runs (buffer_api_t const& buffer, size_t from, size_t to, std::function<void(size_t from, size_t to, std::string const& characterClass)> const& f);
 
 	ranges_t from_string (buffer_api_t const& buffer, std::string const& str);
 	std::string to_s (buffer_api_t const& buffer, ranges_t const& ranges);
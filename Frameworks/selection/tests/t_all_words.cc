@@ -1,6 +1,7 @@
 #include <buffer/buffer.h>
 #include <selection/selection.h>
 #include <text/format.h>
+#include <oak/duration.h>
 
 static std::string all_words (ng::buffer_t const& buf)
 {
@@ -20,3 +21,42 @@ void test_all_words ()
 	OAK_ASSERT_EQ(all_words("南野 繁弘.\n"), "南野, 繁弘");
 	OAK_ASSERT_EQ(all_words("Surrogate: “𠻵”.\n"), "Surrogate, 𠻵");
 }
+
+void test_character_class_runs ()
+{
+	ng::buffer_t buf("foo_bar  42—æble\tgrød\n南野 (c̄̌) “𠻵”.\n");
+
+	std::vector<std::string> expected;
+	std::string charClass = NULL_STR;
+	for(size_t i = 0; i < buf.size(); i += buf[i].size())
+	{
+		std::string const newCharClass = ng::character_class(buf, i);
+		if(newCharClass != charClass)
+			expected.push_back(text::format("%zu: %s", i, newCharClass.c_str()));
+		charClass = newCharClass;
+	}
+
+	std::vector<std::string> actual;
+	size_t last = 0;
+	ng::character_class_runs(buf, 0, buf.size(), [&](size_t from, size_t to, std::string const& characterClass){
+		OAK_ASSERT_EQ(from, last);
+		actual.push_back(text::format("%zu: %s", from, characterClass.c_str()));
+		last = to;
+	});
+
+	OAK_ASSERT_EQ(last, buf.size());
+	OAK_ASSERT_EQ(text::join(actual, ", "), text::join(expected, ", "));
+}
+
+void benchmark_all_words_5_mb ()
+{
+	std::string text;
+	while(text.size() < 5*1024*1024)
+		text += "for(size_t i = 0; i < buffer.size(); ++i) // some words in a comment\n";
+
+	ng::buffer_t buf(text.c_str());
+
+	oak::duration_t timer;
+	size_t words = ng::all_words(buf).size();
+	fprintf(stdout, "found %zu words in %.1f MB in %.2fs\n", words, buf.size() / 1024.0 / 1024.0, timer.duration());
+}
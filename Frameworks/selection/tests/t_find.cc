@@ -1,4 +1,5 @@
 #include <selection/selection.h>
+#include <oak/duration.h>
 
 static std::string search (std::string const& needle, std::string haystack, find::options_t options = find::none, bool* didWrap = nullptr)
 {
@@ -233,3 +234,65 @@ void test_find_regexp ()
 	OAK_ASSERT_EQ(matches("test",  "(?=.)", kRegExp),   "1&1:2&1:3&1:4");
 	OAK_ASSERT_EQ(matches("test", "(?<=.)", kRegExp), "1:2&1:3&1:4&1:5");
 }
+
+void test_find_next_cancel ()
+{
+	ng::buffer_t buffer;
+	buffer.insert(0, "foo bar foo");
+
+	bool didWrap = false;
+	auto res = ng::find_next(buffer, ng::range_t(4), "foo", find::none, &didWrap);
+	OAK_ASSERT_EQ(res.size(), 1);
+	OAK_ASSERT_EQ(res.begin()->first, ng::range_t(8, 11));
+
+	std::atomic_bool cancel(true);
+	OAK_ASSERT(ng::find_next(buffer, ng::range_t(4), "foo", find::none, &didWrap, &cancel).empty());
+}
+
+// With the caret inside a match the next match is searched from the caret, like regular expression searches, rather than being the next of the non-overlapping matches found from the start of the buffer
+void test_find_next_from_inside_match ()
+{
+	ng::buffer_t buffer;
+	buffer.insert(0, "aaaa");
+
+	auto res = ng::find(buffer, ng::ranges_t(ng::index_t(1)), "aa", find::none);
+	OAK_ASSERT_EQ(res.size(), 1);
+	OAK_ASSERT_EQ(res.begin()->first, ng::range_t(1, 3));
+
+	res = ng::find(buffer, ng::ranges_t(ng::index_t(3)), "aa", find::backwards);
+	OAK_ASSERT_EQ(res.size(), 1);
+	OAK_ASSERT_EQ(res.begin()->first, ng::range_t(0, 2));
+
+	res = ng::find(buffer, ng::ranges_t(ng::range_t(1, 3)), "aa", find::wrap_around);
+	OAK_ASSERT_EQ(res.size(), 1);
+	OAK_ASSERT_EQ(res.begin()->first, ng::range_t(0, 2));
+}
+
+void benchmark_find_next_in_large_buffer ()
+{
+	std::string line;
+	for(size_t i = 0; i < 100; ++i)
+		line += "0123456789";
+	line += "\n";
+
+	ng::buffer_t buffer;
+	for(size_t i = 0; i < 100*1024; ++i)
+		buffer.insert(buffer.size(), line);
+	buffer.insert(buffer.size() / 2 + 5000, "needle");
+
+	ng::ranges_t const caret(ng::index_t(buffer.size() / 2));
+
+	oak::duration_t timer;
+	auto all = ng::find_all(buffer, "needle", find::none);
+	auto it = all.upper_bound(caret.last());
+	double fullScan = timer.duration();
+
+	timer.reset();
+	auto next = ng::find(buffer, caret, "needle", find::wrap_around);
+	double incremental = timer.duration();
+
+	OAK_ASSERT(it != all.end());
+	OAK_ASSERT_EQ(next.size(), 1);
+	OAK_ASSERT_EQ(next.begin()->first, it->first);
+	fprintf(stdout, "find next in %.0f MB: %.2f ms scanning everything, %.2f ms scanning from caret\n", buffer.size() / 1024.0 / 1024.0, fullScan * 1000, incremental * 1000);
+}
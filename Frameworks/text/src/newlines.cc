@@ -1,5 +1,83 @@
 #include "newlines.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 std::string const kLF   = "\n";
 std::string const kCR   = "\r";
 std::string const kCRLF = "\r\n";
+
+namespace text
+{
+	// Writing a fixed number of positions per iteration avoids the branch mispredictions of stopping exactly at the last set bit, `dst` must have room for 4 extra entries.
+	static size_t* append_positions (uint64_t mask, size_t offset, size_t* dst)
+	{
+		size_t* const res = dst + __builtin_popcountll(mask);
+		while(mask)
+		{
+			for(size_t i = 0; i < 4; ++i)
+			{
+				*dst++ = offset + __builtin_ctzll(mask | 0x8000000000000000ULL);
+				mask &= mask - 1;
+			}
+		}
+		return res;
+	}
+
+	static uint64_t newlines_mask (char const* buf)
+	{
+#if defined(__AVX2__)
+		__m256i const lf = _mm256_set1_epi8('\n');
+		uint64_t const lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)(buf)), lf));
+		uint64_t const hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)(buf + 32)), lf));
+		return hi << 32 | lo;
+#elif defined(__SSE2__)
+		__m128i const lf = _mm_set1_epi8('\n');
+		uint64_t res = 0;
+		for(size_t i = 0; i < 4; ++i)
+			res |= uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(buf + 16*i)), lf))) << 16*i;
+		return res;
+#elif defined(__ARM_NEON)
+		// NEON has no movemask, so weight each matching byte by its bit and add neighbouring lanes until every 8 bytes are folded into one
+		uint8x16_t const lf = vdupq_n_u8('\n');
+		uint8x16_t const bits = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+		uint8x16_t chunks[4];
+		for(size_t i = 0; i < 4; ++i)
+			chunks[i] = vandq_u8(vceqq_u8(vld1q_u8((uint8_t const*)(buf + 16*i)), lf), bits);
+		uint8x16_t sum = vpaddq_u8(vpaddq_u8(chunks[0], chunks[1]), vpaddq_u8(chunks[2], chunks[3]));
+		sum = vpaddq_u8(sum, sum);
+		return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+#else
+		uint64_t res = 0;
+		for(size_t i = 0; i < 64; ++i)
+			res |= uint64_t(buf[i] == '\n') << i;
+		return res;
+#endif
+	}
+
+	void find_newlines (char const* buf, size_t len, std::vector<size_t>& out, size_t offset)
+	{
+		size_t const kBlockSize = 64, kChunkSize = 16 * kBlockSize;
+		size_t positions[kChunkSize + 4];
+
+		size_t i = 0;
+		while(i + kBlockSize <= len)
+		{
+			size_t* dst = positions;
+			for(size_t end = std::min(len - len % kBlockSize, i + kChunkSize); i < end; i += kBlockSize)
+				dst = append_positions(newlines_mask(buf + i), offset + i, dst);
+			out.insert(out.end(), positions, dst);
+		}
+
+		for(; i < len; ++i)
+		{
+			if(buf[i] == '\n')
+				out.push_back(offset + i);
+		}
+	}
+
+} /* text */
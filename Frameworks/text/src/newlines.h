@@ -11,45 +11,63 @@ namespace text
 	// = Line Feed Support =
 	// =====================
 
-	template <typename _InputIter>
-	std::string estimate_line_endings (_InputIter const& first, _InputIter const& last, std::string const& fallback = kLF)
+	// Estimates line endings from text given in pieces, add() returns false when it has seen enough line endings to decide
+	struct line_endings_estimator_t
 	{
-		size_t const kEnoughSamples = 50;
-
-		size_t lf_count = 0, cr_count = 0, crlf_count = 0;
-		bool prevWasCR = false;
-
-		for(auto it = first; it != last; ++it)
+		template <typename _InputIter>
+		bool add (_InputIter const& first, _InputIter const& last)
 		{
-			if(*it == '\n')
+			size_t const kEnoughSamples = 50;
+
+			for(auto it = first; it != last && !_done; ++it)
 			{
-				if(prevWasCR)
+				if(*it == '\n')
 				{
-					if(++crlf_count == kEnoughSamples)
-						break;
-					prevWasCR = false;
+					if(_prev_was_cr)
+					{
+						if(++_crlf_count == kEnoughSamples)
+							_done = true;
+						_prev_was_cr = false;
+					}
+					else
+					{
+						if(++_lf_count == kEnoughSamples)
+							_done = true;
+					}
 				}
 				else
 				{
-					if(++lf_count == kEnoughSamples)
-						break;
+					if(_prev_was_cr && (++_cr_count == kEnoughSamples))
+						_done = true;
+					_prev_was_cr = *it == '\r';
 				}
 			}
-			else
-			{
-				if(prevWasCR && (++cr_count == kEnoughSamples))
-					break;
-				prevWasCR = *it == '\r';
-			}
+			return !_done;
 		}
 
-		if(lf_count == 0 && cr_count == 0 && crlf_count > 0)
-			return kCRLF;
-		else if(lf_count == 0 && crlf_count == 0 && cr_count > 0)
-			return kCR;
-		else if(lf_count != 0)
-			return kLF;
-		return fallback;
+		std::string result (std::string const& fallback = kLF) const
+		{
+			if(_lf_count == 0 && _cr_count == 0 && _crlf_count > 0)
+				return kCRLF;
+			else if(_lf_count == 0 && _crlf_count == 0 && _cr_count > 0)
+				return kCR;
+			else if(_lf_count != 0)
+				return kLF;
+			return fallback;
+		}
+
+	private:
+		size_t _lf_count = 0, _cr_count = 0, _crlf_count = 0;
+		bool _prev_was_cr = false;
+		bool _done = false;
+	};
+
+	template <typename _InputIter>
+	std::string estimate_line_endings (_InputIter const& first, _InputIter const& last, std::string const& fallback = kLF)
+	{
+		line_endings_estimator_t estimator;
+		estimator.add(first, last);
+		return estimator.result(fallback);
 	}
 
 	template <typename _InputIter>
@@ -70,6 +88,9 @@ namespace text
 		return out;
 	}
 
+	// Appends `offset + i` to `out` for each `buf[i]` that is a line feed.
+	void find_newlines (char const* buf, size_t len, std::vector<size_t>& out, size_t offset = 0);
+
 } /* text */
 
 #endif /* end of include guard: TEXT_NEWLINES_H_CYET9RUW */
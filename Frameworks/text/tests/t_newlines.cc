@@ -0,0 +1,66 @@
+#include <text/newlines.h>
+#include <oak/duration.h>
+
+static std::vector<size_t> naive_newlines (std::string const& str, size_t first, size_t last)
+{
+	std::vector<size_t> res;
+	for(size_t i = first; i < last; ++i)
+	{
+		if(str[i] == '\n')
+			res.push_back(100 + i - first);
+	}
+	return res;
+}
+
+void test_find_newlines ()
+{
+	std::string str(300, 'x');
+	for(size_t round = 0; round < 50; ++round)
+	{
+		for(size_t i = arc4random_uniform(round % 5 ? 30 : 300); i > 0; --i)
+			str[arc4random_uniform(str.size())] = round % 3 ? '\n' : '\n' + 128;
+
+		for(size_t first = 0; first < 70; ++first)
+		{
+			for(size_t last : { first, first + 1, first + 63, first + 64, first + 65, str.size() - 1, str.size() })
+			{
+				std::vector<size_t> positions;
+				text::find_newlines(str.data() + first, last - first, positions, 100);
+				OAK_ASSERT(positions == naive_newlines(str, first, last));
+			}
+		}
+	}
+
+	std::vector<size_t> positions = { 42 };
+	text::find_newlines("a\nb\n", 4, positions);
+	OAK_ASSERT_EQ(positions.size(), 3);
+	OAK_ASSERT_EQ(positions[1], 1);
+	OAK_ASSERT_EQ(positions[2], 3);
+}
+
+void test_line_endings_estimator ()
+{
+	for(std::string const& str : { "a\r\nb\r\nc", "a\rb\rc", "a\nb\r\nc", "abc" })
+	{
+		text::line_endings_estimator_t estimator;
+		for(size_t i = 0; i < str.size(); ++i) // a CRLF split between pieces is still one line ending
+			estimator.add(str.begin() + i, str.begin() + i + 1);
+		OAK_ASSERT_EQ(estimator.result(), text::estimate_line_endings(str.begin(), str.end()));
+	}
+}
+
+void benchmark_find_newlines ()
+{
+	std::string str(256 * 1024 * 1024, 'x');
+	for(size_t i = 0; i < str.size(); i += 1 + arc4random_uniform(80))
+		str[i] = '\n';
+
+	std::vector<size_t> positions;
+	positions.reserve(str.size() / 30);
+
+	oak::duration_t timer;
+	text::find_newlines(str.data(), str.size(), positions);
+	double const seconds = timer.duration();
+
+	fprintf(stdout, "%zu newlines in %zu MB: %.1f ms (%.1f GB/s)\n", positions.size(), str.size() / (1024 * 1024), seconds * 1000, str.size() / seconds / 1e9);
+}
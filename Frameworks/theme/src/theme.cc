@@ -273,6 +273,10 @@ void theme_t::shared_styles_t::setup_styles ()
 	if(!_color_space)
 		_color_space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
 
+	_selectors = scope::selector_set_t();
+	for(auto const& style : _styles)
+		_selectors.add(style.scope_selector);
+
 	// =======================================
 	// = Find “global” foreground/background =
 	// =======================================
@@ -391,11 +395,8 @@ styles_t const& theme_t::styles_for_scope (scope::scope_t const& scope) const
 				ordering.emplace(*rank, it);
 		}
 
-		for(auto const& it : _styles->_styles)
-		{
-			if(auto rank = it.scope_selector.does_match(scope))
-				ordering.emplace(*rank, it);
-		}
+		for(auto const& match : _styles->_selectors.match(scope))
+			ordering.emplace(match.second, _styles->_styles[match.first]);
 
 		decomposed_style_t base(scope::selector_t(), _font_name, _font_size);
 		for(auto const& it : ordering)
@@ -134,6 +134,7 @@ private:
 		bundles::item_ptr _item;
 		CGColorSpaceRef _color_space = NULL;
 		std::vector<decomposed_style_t> _styles;
+		scope::selector_set_t _selectors; // index over the scope selectors of _styles
 		gutter_styles_t _gutter_styles;
 		CGColorPtr _foreground;
 		CGColorPtr _background;
@@ -101,6 +101,17 @@ namespace ng
 		return res;
 	}
 
+	memory_usage_t undo_manager_t::memory_usage () const
+	{
+		size_t bytes = _records.capacity() * sizeof(record_t);
+		for(auto const& r : _records)
+			bytes += heap_size(r.before) + heap_size(r.after) + (r.pre_selection.size() + r.post_selection.size()) * sizeof(range_t);
+
+		memory_usage_t res;
+		res.add("undo", bytes, _records.size());
+		return res;
+	}
+
 	void undo_manager_t::will_replace (size_t from, size_t to, char const* buf, size_t len)
 	{
 		_records.erase(_records.begin() + _index, _records.end());
@@ -21,6 +21,8 @@ namespace ng
 		ranges_t undo ();
 		ranges_t redo ();
 
+		memory_usage_t memory_usage () const;
+
 	private:
 		void will_replace (size_t from, size_t to, char const* buf, size_t len);
 
@@ -10,11 +10,11 @@ namespace oak
 	struct basic_tree_t
 	{
 		basic_tree_t ()                                   { }
-		basic_tree_t (basic_tree_t&& rhs)                 { _root = rhs._root; _size = rhs._size; rhs._root = node_t::null_ptr(); rhs._size = 0; }
+		basic_tree_t (basic_tree_t&& rhs)                 { swap(rhs); }
 		basic_tree_t (basic_tree_t const& rhs)            { _root = clone_node(rhs._root); _size = rhs._size; }
 		~basic_tree_t ()                                  { clear(); }
-		basic_tree_t& operator= (basic_tree_t&& rhs)      { _root = rhs._root; _size = rhs._size; rhs._root = node_t::null_ptr(); rhs._size = 0; return *this; }
-		basic_tree_t& operator= (basic_tree_t const& rhs) { _root = clone_node(rhs._root); _size = rhs._size; return *this; }
+		basic_tree_t& operator= (basic_tree_t&& rhs)      { clear(); swap(rhs); return *this; }
+		basic_tree_t& operator= (basic_tree_t const& rhs) { if(this != &rhs) { clear(); _root = clone_node(rhs._root); _size = rhs._size; } return *this; }
 
 		struct value_type
 		{
@@ -109,6 +109,77 @@ namespace oak
 
 		static bool eq (node_t* lhs, node_t* rhs) { return (lhs->is_null() && rhs->is_null()) || lhs == rhs; }
 
+		// Nodes are allocated from slabs owned by the tree, keeping a tree’s nodes close in memory, and reused via a free list. Slabs are only released when the tree is cleared.
+		struct node_pool_t
+		{
+			node_pool_t () { }
+			node_pool_t (node_pool_t const& rhs) = delete;
+			node_pool_t& operator= (node_pool_t const& rhs) = delete;
+
+			template <typename... _Args>
+			node_t* create (_Args&&... args)
+			{
+				void* slot;
+				if(_free)
+				{
+					slot  = _free;
+					_free = _free->next;
+				}
+				else
+				{
+					if(_slabs.empty() || _used == _slab_size)
+					{
+						_slab_size = _slabs.empty() ? kMinSlabSize : std::min(2 * _slab_size, kMaxSlabSize);
+						_slabs.emplace_back(new slot_t[_slab_size]);
+						_used = 0;
+					}
+					slot = &_slabs.back()[_used++];
+				}
+				return new(slot) node_t(std::forward<_Args>(args)...);
+			}
+
+			void destroy (node_t* node)
+			{
+				node->~node_t();
+				_free = new(node) free_t{ _free };
+			}
+
+			// All nodes must have been destroyed
+			void release ()
+			{
+				_slabs.clear();
+				_free = nullptr;
+				_used = _slab_size = 0;
+			}
+
+			size_t bytes () const
+			{
+				size_t res = 0, slabSize = kMinSlabSize;
+				for(size_t i = 0; i < _slabs.size(); ++i, slabSize = std::min(2 * slabSize, kMaxSlabSize))
+					res += slabSize * sizeof(slot_t);
+				return res + _slabs.capacity() * sizeof(_slabs[0]);
+			}
+
+			void swap (node_pool_t& rhs)
+			{
+				_slabs.swap(rhs._slabs);
+				std::swap(_free, rhs._free);
+				std::swap(_used, rhs._used);
+				std::swap(_slab_size, rhs._slab_size);
+			}
+
+		private:
+			static constexpr size_t kMinSlabSize = 8;
+			static constexpr size_t kMaxSlabSize = 4096;
+
+			struct free_t { free_t* next; };
+			typedef std::aligned_storage_t<std::max(sizeof(node_t), sizeof(free_t)), std::max(alignof(node_t), alignof(free_t))> slot_t;
+
+			std::vector<std::unique_ptr<slot_t[]>> _slabs;
+			free_t* _free = nullptr;
+			size_t _used = 0, _slab_size = 0;
+		};
+
 	public:
 		struct iterator : std::iterator<std::bidirectional_iterator_tag, value_type>
 		{
@@ -199,13 +270,31 @@ namespace oak
 
 		size_t size () const                 { return _size; }
 		bool empty () const                  { return _size == 0; }
-		void clear ()                        { dispose_node(_root, true); _root = node_t::null_ptr(); _size = 0; }
-		void swap (basic_tree_t& rhs)        { std::swap(_root, rhs._root); std::swap(_size, rhs._size); }
+		size_t memory_usage () const         { return _pool.bytes(); }
+		void swap (basic_tree_t& rhs)        { std::swap(_root, rhs._root); std::swap(_size, rhs._size); _pool.swap(rhs._pool); }
+
+		void clear ()
+		{
+			if(!std::is_trivially_destructible<node_t>::value) // otherwise releasing the slabs is enough
+				dispose_node(_root, true);
+			_root = node_t::null_ptr();
+			_size = 0;
+			_pool.release();
+		}
 
 		iterator insert (iterator const& it, _KeyT const& key)                { return insert(it, key, _ValueT()); }
-		iterator insert (iterator it, _KeyT const& key, _ValueT const& value) { return insert_node(it._node, new node_t(key, value)); }
+		iterator insert (iterator it, _KeyT const& key, _ValueT const& value) { return insert_node(it._node, _pool.create(key, value)); }
 		void erase (iterator const& it)                                       { if(it != end()) remove_node(it._node); }
 
+		// Replace content with the (key, value) pairs in [first, last) in linear time by building a balanced tree directly
+		template <typename _RandomAccessIter>
+		void assign (_RandomAccessIter first, _RandomAccessIter last)
+		{
+			clear();
+			_size = std::distance(first, last);
+			_root = build_tree(first, _size, node_t::null_ptr());
+		}
+
 		void erase (iterator it, iterator const& last)
 		{
 			while(it != last)
@@ -396,7 +485,7 @@ namespace oak
 			return res;
 		}
 
-		static void dispose_node (node_t* node, bool recursive)
+		void dispose_node (node_t* node, bool recursive)
 		{
 			if(node->is_null())
 				return;
@@ -413,7 +502,7 @@ namespace oak
 			}
 
 			for(auto const& node : queue)
-				delete node;
+				_pool.destroy(node);
 		}
 
 		void remove_node (node_t* node)
@@ -496,12 +585,31 @@ namespace oak
 			dispose_node(node, false);
 		}
 
-		static node_t* clone_node (node_t* node, node_t* parent = node_t::null_ptr())
+		// The larger half goes to the right subtree and a node’s level is one more than its left child’s, which satisfies the AA-tree invariants for any count
+		template <typename _RandomAccessIter>
+		node_t* build_tree (_RandomAccessIter first, size_t count, node_t* parent)
+		{
+			if(count == 0)
+				return node_t::null_ptr();
+
+			size_t const leftCount = (count - 1) / 2;
+			auto const& pair = first[leftCount];
+
+			node_t* res = _pool.create(pair.first, pair.second);
+			res->_parent = parent;
+			res->_left   = build_tree(first, leftCount, res);
+			res->_right  = build_tree(first + leftCount + 1, count - leftCount - 1, res);
+			res->_level  = res->_left->_level + 1;
+			res->update_key_offset();
+			return res;
+		}
+
+		node_t* clone_node (node_t* node, node_t* parent = node_t::null_ptr())
 		{
 			if(node->is_null())
 				return node;
 
-			node_t* res = new node_t(node->_relative_key, node->_value);
+			node_t* res = _pool.create(node->_relative_key, node->_value);
 			res->_left       = clone_node(node->_left,  res);
 			res->_right      = clone_node(node->_right, res);
 			res->_parent     = parent;
@@ -513,6 +621,7 @@ namespace oak
 	private:
 		node_t* _root = node_t::null_ptr();
 		size_t _size = 0;
+		node_pool_t _pool;
 	};
 
 } /* oak */